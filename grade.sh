@@ -1,6 +1,15 @@
 #!/bin/bash
 set -u
 
+# Each line of the spec is: test frames blocks nodiff [VAR=value ...].
+# With nodiff 0 both outputs must match the expected ones; with 1 they
+# are not checked; with 2 the test's processes run at once, so only the
+# lines logged with uvm_syslog are compared in the MMU's output, in any
+# order; with 3 the MMU keeps its disk in mmu.swap, and once the test
+# ran it is restarted on the same file and the test runs again with
+# the argument "restart", both outputs being compared like with 0.
+# The assignments that follow set the MMU's environment, such as the
+# PAGER_* variables enabling optional pager features.
 TESTSPEC=tests/tests.spec
 # TESTSPEC=tests/test11.spec
 
@@ -8,23 +17,39 @@ make
 
 mkdir -p log
 
-while read -r num frames blocks nodiff ; do
+while read -r num frames blocks nodiff envs ; do
     num=$((num))
     frames=$((frames))
     blocks=$((blocks))
     nodiff=$((nodiff))
     echo "running test$num"
-    rm -rf mmu.sock mmu.pmem.img.*
-    ./bin/mmu $frames $blocks &> log/test$num.mmu.out &
+    swapfile=""
+    if [ $nodiff -eq 3 ] ; then
+        swapfile=mmu.swap
+    fi
+    rm -rf mmu.sock mmu.pmem.img.* mmu.swap*
+    env $envs ./bin/mmu $frames $blocks $swapfile &> log/test$num.mmu.out &
     sleep 1s
     ./bin/test$num &> log/test$num.out
     kill -SIGINT %1
     wait
-    rm -rf mmu.sock mmu.pmem.img.*
+    if [ $nodiff -eq 3 ] ; then
+        env $envs ./bin/mmu $frames $blocks $swapfile &>> log/test$num.mmu.out &
+        sleep 1s
+        ./bin/test$num restart &>> log/test$num.out
+        kill -SIGINT %1
+        wait
+    fi
+    rm -rf mmu.sock mmu.pmem.img.* mmu.swap*
     if [ $nodiff -eq 1 ] ; then
         continue
     fi
-    if ! diff tests/test$num.mmu.out log/test$num.mmu.out > /dev/null ; then
+    if [ $nodiff -eq 2 ] ; then
+        if ! diff <(grep -E '^[0-9a-f]+$' tests/test$num.mmu.out | sort) \
+                <(grep -E '^[0-9a-f]+$' log/test$num.mmu.out | sort) > /dev/null ; then
+            echo "test$num.mmu.out differs"
+        fi
+    elif ! diff tests/test$num.mmu.out log/test$num.mmu.out > /dev/null ; then
         echo "test$num.mmu.out differs"
     fi
     if ! diff tests/test$num.out log/test$num.out > /dev/null ; then
@@ -0,0 +1,282 @@
+/* The benchmark drives the pager in-process (see mmustub.h) with
+ * synthetic workloads, so it measures the cost of the pager alone,
+ * without sockets or client processes.
+ *
+ * Each run creates a number of clients, extends every page they can
+ * get (swap is split evenly among them, up to the address space), and
+ * has them access pages in turn, one access each.  Workloads are
+ * uniform (random pages), zipf (random pages, skewed by a Zipf
+ * distribution with exponent 0.99), scan (every page in order), loop
+ * (the first 1.5 * NFRAMES pages in order, so LRU-like replacement
+ * misses every time), and mix (clients take turns among the other
+ * four).  Every workload is run with every combination of frames,
+ * blocks and clients, each in a child process, and one line is
+ * printed for each run. */
+
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "hist.h"
+
+#include "mmu.h"
+#include "mmustub.h"
+#include "pager.h"
+
+/****************************************************************************
+ * structure definitions and static variables
+ ***************************************************************************/
+#define BENCH_MAX_PAGES 256
+#define BENCH_MAX_LIST 16
+#define BENCH_ZIPF_EXPONENT 0.99
+
+enum bench_pattern { UNIFORM, ZIPF, SCAN, LOOP, NPATTERNS };
+static const char *patterns[] = { "uniform", "zipf", "scan", "loop", "mix" };
+
+struct bench_run {/*{{{*/
+	int workload; /* a pattern, or NPATTERNS for mix */
+	int nframes;
+	int nblocks;
+	int nclients;
+	long naccesses;
+	int writes; /* percentage of accesses that write */
+};/*}}}*/
+
+struct bench_client {/*{{{*/
+	pid_t pid;
+	int pattern;
+	int npages;
+	int next; /* page, for SCAN and LOOP */
+	int nloop; /* pages in the LOOP */
+};/*}}}*/
+
+static size_t PAGESIZE = 0;
+static uint64_t rng = 0;
+static double *zipf_cdf = NULL;
+
+/****************************************************************************
+ * static function declarations
+ ***************************************************************************/
+static void bench_run(const struct bench_run *run);
+static void bench_replay(const struct bench_run *run);
+static int bench_next_page(struct bench_client *c);
+static void bench_init_zipf(int npages);
+static uint64_t bench_random(void);
+static int bench_parse_list(char *arg, int *list);
+
+/****************************************************************************
+ * workload functions {{{
+ ***************************************************************************/
+void bench_run(const struct bench_run *run)/*{{{*/
+{
+	fflush(stdout);
+	pid_t child = fork();
+	if(child == -1) {
+		perror("fork");
+		exit(EXIT_FAILURE);
+	}
+	if(child == 0) {
+		bench_replay(run);
+		exit(EXIT_SUCCESS);
+	}
+	int status;
+	waitpid(child, &status, 0);
+	if(!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+		printf("%s %d %d %d failed\n", patterns[run->workload],
+				run->nframes, run->nblocks, run->nclients);
+}/*}}}*/
+
+void bench_replay(const struct bench_run *run)/*{{{*/
+{
+	struct bench_client clients[MMUSTUB_MAX_PIDS];
+	int npages = run->nblocks / run->nclients;
+	if(npages > BENCH_MAX_PAGES) npages = BENCH_MAX_PAGES;
+
+	rng = 0x9e3779b97f4a7c15ULL;
+	bench_init_zipf(npages);
+	mmustub_init(run->nframes, run->nblocks);
+	pager_init(run->nframes, run->nblocks);
+
+	for(int i = 0; i < run->nclients; ++i) {
+		struct bench_client *c = &clients[i];
+		c->pid = i + 1;
+		c->pattern = run->workload == NPATTERNS ? i % NPATTERNS
+				: run->workload;
+		c->npages = npages;
+		c->next = 0;
+		c->nloop = run->nframes + run->nframes / 2;
+		if(c->nloop > npages) c->nloop = npages;
+		mmustub_create(c->pid);
+		pager_create(c->pid);
+		for(int j = 0; j < npages; ++j) {
+			if(pager_extend(c->pid) == NULL) {
+				fprintf(stderr, "pid %d: out of swap\n", c->pid);
+				exit(EXIT_FAILURE);
+			}
+		}
+	}
+
+	uint64_t start = hist_now();
+	for(long i = 0; i < run->naccesses; ++i) {
+		struct bench_client *c = &clients[i % run->nclients];
+		int page = bench_next_page(c);
+		void *vaddr = (void *)(UVM_BASEADDR + (intptr_t)page * PAGESIZE);
+		int write = (int)(bench_random() % 100) < run->writes;
+		int prot = write ? PROT_READ | PROT_WRITE : PROT_READ;
+		if(mmustub_access(c->pid, vaddr, prot) == -1) {
+			fprintf(stderr, "pid %d page %d: access not granted\n",
+					c->pid, page);
+			exit(EXIT_FAILURE);
+		}
+	}
+	uint64_t elapsed = hist_now() - start;
+
+	struct pager_stats total;
+	pager_stats(-1, NULL, &total);
+	uint64_t faults = total.minor_faults + total.major_faults;
+	double secs = elapsed / 1e9;
+	printf("%s %d %d %d %ld %llu %llu %llu %.0f %.0f\n",
+			patterns[run->workload], run->nframes, run->nblocks,
+			run->nclients, run->naccesses,
+			(unsigned long long)faults,
+			(unsigned long long)total.evictions,
+			(unsigned long long)total.writebacks,
+			run->naccesses / secs, faults / secs);
+
+	for(int i = 0; i < run->nclients; ++i)
+		pager_destroy(clients[i].pid);
+}/*}}}*/
+
+int bench_next_page(struct bench_client *c)/*{{{*/
+{
+	int page;
+	switch(c->pattern) {
+	case UNIFORM:
+		return (int)(bench_random() % c->npages);
+	case ZIPF: {
+		double u = (bench_random() >> 11) * (1.0 / 9007199254740992.0);
+		int lo = 0, hi = c->npages - 1;
+		while(lo < hi) {
+			int mid = (lo + hi) / 2;
+			if(zipf_cdf[mid] < u) lo = mid + 1;
+			else hi = mid;
+		}
+		return lo;
+	}
+	case SCAN:
+		page = c->next;
+		c->next = (c->next + 1) % c->npages;
+		return page;
+	default: /* LOOP */
+		page = c->next % c->nloop;
+		c->next = (page + 1) % c->nloop;
+		return page;
+	}
+}/*}}}*/
+
+void bench_init_zipf(int npages)/*{{{*/
+{
+	zipf_cdf = malloc(npages * sizeof(double));
+	if(!zipf_cdf) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+	double sum = 0;
+	for(int i = 0; i < npages; ++i) {
+		sum += 1.0 / pow(i + 1, BENCH_ZIPF_EXPONENT);
+		zipf_cdf[i] = sum;
+	}
+	for(int i = 0; i < npages; ++i)
+		zipf_cdf[i] /= sum;
+}/*}}}*/
+
+uint64_t bench_random(void)/*{{{*/
+{
+	/* xorshift64*, deterministic so runs are comparable */
+	rng ^= rng >> 12;
+	rng ^= rng << 25;
+	rng ^= rng >> 27;
+	return rng * 0x2545f4914f6cdd1dULL;
+}/*}}}*/
+
+int bench_parse_list(char *arg, int *list)/*{{{*/
+{
+	int n = 0;
+	for(char *v = strtok(arg, ","); v && n < BENCH_MAX_LIST; v = strtok(NULL, ","))
+		list[n++] = atoi(v);
+	return n;
+}/*}}}*/
+/*}}}*/
+
+void usage(int argc, char **argv) {/*{{{*/
+	printf("usage: %s [-w WORKLOAD,...] [-f NFRAMES,...] [-b NBLOCKS,...]\n",
+			argv[0]);
+	printf("       [-c NCLIENTS,...] [-n NACCESSES] [-W WRITE%%]\n");
+	printf("\n");
+	printf("workloads: uniform zipf scan loop mix (default all)\n");
+	printf("defaults: -f 16,64,256 -b 1024 -c 1,4 -n 200000 -W 25\n");
+	printf("\n");
+	printf("valid ranges: 2 <= NFRAMES <= 256\n");
+	printf("              4 <= NBLOCKS <= 1024\n");
+	printf("              1 <= NCLIENTS <= NBLOCKS / 4\n");
+	printf("\n");
+	printf("prints: workload nframes nblocks nclients accesses faults\n");
+	printf("        evictions writebacks accesses/s faults/s\n");
+	exit(EXIT_FAILURE);
+}/*}}}*/
+
+int main(int argc, char **argv) {/*{{{*/
+	int workloads[BENCH_MAX_LIST] = { UNIFORM, ZIPF, SCAN, LOOP, NPATTERNS };
+	int frames[BENCH_MAX_LIST] = { 16, 64, 256 };
+	int blocks[BENCH_MAX_LIST] = { 1024 };
+	int clients[BENCH_MAX_LIST] = { 1, 4 };
+	int nworkloads = NPATTERNS + 1, nframes = 3, nblocks = 1, nclients = 2;
+	long naccesses = 200000;
+	int writes = 25;
+	int opt;
+	while((opt = getopt(argc, argv, "w:f:b:c:n:W:")) != -1) {
+		switch(opt) {
+		case 'w':
+			nworkloads = 0;
+			for(char *v = strtok(optarg, ","); v; v = strtok(NULL, ",")) {
+				int w = 0;
+				while(w <= NPATTERNS && strcmp(v, patterns[w])) w++;
+				if(w > NPATTERNS || nworkloads == BENCH_MAX_LIST)
+					usage(argc, argv);
+				workloads[nworkloads++] = w;
+			}
+			break;
+		case 'f': nframes = bench_parse_list(optarg, frames); break;
+		case 'b': nblocks = bench_parse_list(optarg, blocks); break;
+		case 'c': nclients = bench_parse_list(optarg, clients); break;
+		case 'n': naccesses = atol(optarg); break;
+		case 'W': writes = atoi(optarg); break;
+		default: usage(argc, argv);
+		}
+	}
+	if(optind != argc || naccesses < 1 || writes < 0 || writes > 100)
+		usage(argc, argv);
+	PAGESIZE = sysconf(_SC_PAGESIZE);
+
+	for(int w = 0; w < nworkloads; ++w)
+	for(int f = 0; f < nframes; ++f)
+	for(int b = 0; b < nblocks; ++b)
+	for(int c = 0; c < nclients; ++c) {
+		struct bench_run run = { workloads[w], frames[f], blocks[b],
+				clients[c], naccesses, writes };
+		if(run.nframes < 2 || run.nframes > 256
+				|| run.nblocks < 4 || run.nblocks > 1024
+				|| run.nclients < 1 || run.nclients > run.nblocks / 4
+				|| run.nclients > MMUSTUB_MAX_PIDS)
+			usage(argc, argv);
+		bench_run(&run);
+	}
+	exit(EXIT_SUCCESS);
+}/*}}}*/
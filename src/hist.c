@@ -0,0 +1,132 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "hist.h"
+#include "log.h"
+
+/*****************************************************************************
+ * hist struct and function declarations
+ ****************************************************************************/
+/* Values below 2^HIST_SUB_BITS get a bucket each; above that, each power of
+ * two is split in 2^HIST_SUB_BITS buckets. */
+#define HIST_SUB_BITS 5
+#define HIST_SUB_BUCKETS (1 << HIST_SUB_BITS)
+#define HIST_NBUCKETS ((64 - HIST_SUB_BITS + 1) * HIST_SUB_BUCKETS)
+
+struct hist {
+	const char *name;
+	struct hist *next;
+	uint64_t count;
+	uint64_t max;
+	uint64_t buckets[HIST_NBUCKETS];
+};
+
+static int hist_bucket(uint64_t value);
+static uint64_t hist_bucket_high(int bucket);
+
+static struct hist *hists = NULL;
+static pthread_mutex_t hists_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/*****************************************************************************
+ * public functions
+ ****************************************************************************/
+struct hist * hist_create(const char *name)
+{
+	struct hist *h = calloc(1, sizeof(*h));
+	if(!h) logea(__FILE__, __LINE__, NULL);
+	h->name = name;
+	pthread_mutex_lock(&hists_mutex);
+	struct hist **tail = &hists;
+	while(*tail) tail = &(*tail)->next;
+	*tail = h;
+	pthread_mutex_unlock(&hists_mutex);
+	return h;
+}
+
+uint64_t hist_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+void hist_record(struct hist *h, uint64_t ns)
+{
+	__atomic_fetch_add(&h->buckets[hist_bucket(ns)], 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&h->count, 1, __ATOMIC_RELAXED);
+	uint64_t max = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+	while(ns > max && !__atomic_compare_exchange_n(&h->max, &max, ns, 1,
+				__ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+void hist_record_since(struct hist *h, uint64_t start)
+{
+	uint64_t now = hist_now();
+	hist_record(h, now > start ? now - start : 0);
+}
+
+uint64_t hist_count(const struct hist *h)
+{
+	return __atomic_load_n(&h->count, __ATOMIC_RELAXED);
+}
+
+uint64_t hist_percentile(const struct hist *h, double p)
+{
+	/* Buckets are summed rather than trusting count, which writers
+	 * update separately. */
+	uint64_t total = 0;
+	for(int i = 0; i < HIST_NBUCKETS; ++i)
+		total += __atomic_load_n(&h->buckets[i], __ATOMIC_RELAXED);
+	if(total == 0) return 0;
+	uint64_t rank = (uint64_t)(p * total);
+	if(rank < p * total || rank == 0) rank++;
+	if(rank > total) rank = total;
+	uint64_t seen = 0;
+	for(int i = 0; i < HIST_NBUCKETS; ++i) {
+		seen += __atomic_load_n(&h->buckets[i], __ATOMIC_RELAXED);
+		if(seen < rank) continue;
+		uint64_t high = hist_bucket_high(i);
+		uint64_t max = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+		return high < max ? high : max;
+	}
+	return __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+}
+
+void hist_log_all(int verbosity)
+{
+	pthread_mutex_lock(&hists_mutex);
+	for(struct hist *h = hists; h; h = h->next) {
+		logd(verbosity, "latency %s: %llu samples, p50 %llu p99 %llu "
+				"p999 %llu max %llu ns\n", h->name,
+				(unsigned long long)hist_count(h),
+				(unsigned long long)hist_percentile(h, 0.5),
+				(unsigned long long)hist_percentile(h, 0.99),
+				(unsigned long long)hist_percentile(h, 0.999),
+				(unsigned long long)__atomic_load_n(&h->max,
+					__ATOMIC_RELAXED));
+	}
+	pthread_mutex_unlock(&hists_mutex);
+}
+
+/*****************************************************************************
+ * static functions
+ ****************************************************************************/
+static int hist_bucket(uint64_t value)
+{
+	if(value < HIST_SUB_BUCKETS) return (int)value;
+	int exp = 63 - __builtin_clzll(value);
+	int shift = exp - HIST_SUB_BITS;
+	int sub = (int)((value >> shift) & (HIST_SUB_BUCKETS - 1));
+	return (shift + 1) * HIST_SUB_BUCKETS + sub;
+}
+
+static uint64_t hist_bucket_high(int bucket)
+{
+	if(bucket < HIST_SUB_BUCKETS) return (uint64_t)bucket;
+	int shift = bucket / HIST_SUB_BUCKETS - 1;
+	uint64_t sub = bucket % HIST_SUB_BUCKETS;
+	uint64_t low = (HIST_SUB_BUCKETS + sub) << shift;
+	return low + ((uint64_t)1 << shift) - 1;
+}
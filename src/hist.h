@@ -0,0 +1,46 @@
+/* This module keeps latency histograms in the spirit of HdrHistogram: values
+ * are counted in log-linear buckets (32 per power of two), so any percentile
+ * is known within about 3% whatever its magnitude, in constant memory.
+ * Recording takes a single atomic increment and no locks, so histograms can
+ * stay enabled in production.  The interface is as follows:
+ *
+ * (1) create a histogram with =hist_create=
+ * (2) time something with =hist_now= and count it with =hist_record=
+ * (3) query percentiles with =hist_percentile=, or log every histogram
+ *     with =hist_log_all=.
+ *
+ * Histograms are never destroyed; they live until the program exits. */
+
+#ifndef __HIST_HEADER__
+#define __HIST_HEADER__
+
+#include <stdint.h>
+
+/* This function creates a histogram called =name= (which is not copied) and
+ * adds it to the list logged by =hist_log_all=. */
+struct hist * hist_create(const char *name);
+
+/* This function returns a monotonic timestamp in nanoseconds. */
+uint64_t hist_now(void);
+
+/* This function counts the value =ns= in histogram =h=.  It is thread-safe
+ * and async-signal-safe. */
+void hist_record(struct hist *h, uint64_t ns);
+
+/* This function counts the time elapsed since =start= (from =hist_now=) in
+ * histogram =h=. */
+void hist_record_since(struct hist *h, uint64_t start);
+
+/* This function returns the number of values counted in =h=. */
+uint64_t hist_count(const struct hist *h);
+
+/* This function returns the smallest value such that at least a fraction
+ * =p= (between 0 and 1) of the values counted in =h= are no greater than
+ * it, rounded up to its bucket.  Returns 0 if =h= is empty. */
+uint64_t hist_percentile(const struct hist *h, double p);
+
+/* This function logs the count, 50th, 99th and 99.9th percentiles, and
+ * maximum of every histogram at verbosity =verbosity=. */
+void hist_log_all(int verbosity);
+
+#endif
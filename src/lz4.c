@@ -0,0 +1,149 @@
+/* This code implements the LZ4 block format; see lz4.h. */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "lz4.h"
+
+/*****************************************************************************
+ * format constants and helper declarations
+ ****************************************************************************/
+#define LZ4_MINMATCH 4
+#define LZ4_MAXOFFSET 65535
+/* the last match must start this many bytes before the end of the input */
+#define LZ4_MFLIMIT 12
+/* the last bytes of the input are always literals */
+#define LZ4_LASTLITERALS 5
+#define LZ4_HASHLOG 12
+
+static uint32_t lz4_read32(const char *p);
+static int lz4_hash(uint32_t seq);
+static int lz4_sequence(char *dst, int dstlen, int op, const char *lit,
+		int nlit, int offset, int mlen);
+static int lz4_length(char *dst, int op, int n);
+
+/*****************************************************************************
+ * public functions
+ ****************************************************************************/
+int lz4_compress(const char *src, int len, char *dst, int dstlen)
+{
+	int table[1 << LZ4_HASHLOG];
+	for(int i = 0; i < (1 << LZ4_HASHLOG); ++i) table[i] = -1;
+
+	int ip = 0;
+	int anchor = 0;
+	int op = 0;
+	while(ip < len - LZ4_MFLIMIT) {
+		uint32_t seq = lz4_read32(src + ip);
+		int h = lz4_hash(seq);
+		int ref = table[h];
+		table[h] = ip;
+		if(ref == -1 || ip - ref > LZ4_MAXOFFSET ||
+				lz4_read32(src + ref) != seq) {
+			ip++;
+			continue;
+		}
+		int mlen = LZ4_MINMATCH;
+		while(ip + mlen < len - LZ4_LASTLITERALS &&
+				src[ref + mlen] == src[ip + mlen])
+			mlen++;
+		op = lz4_sequence(dst, dstlen, op, src + anchor, ip - anchor,
+				ip - ref, mlen);
+		if(op == -1) return 0;
+		ip += mlen;
+		anchor = ip;
+	}
+	op = lz4_sequence(dst, dstlen, op, src + anchor, len - anchor, 0, 0);
+	return op == -1 ? 0 : op;
+}
+
+int lz4_decompress(const char *src, int len, char *dst, int dstlen)
+{
+	int ip = 0;
+	int op = 0;
+	while(ip < len) {
+		uint8_t token = (uint8_t)src[ip++];
+		int nlit = token >> 4;
+		if(nlit == 15) {
+			uint8_t b;
+			do {
+				if(ip >= len) return -1;
+				b = (uint8_t)src[ip++];
+				nlit += b;
+			} while(b == 255);
+		}
+		if(nlit > len - ip || nlit > dstlen - op) return -1;
+		memcpy(dst + op, src + ip, nlit);
+		ip += nlit;
+		op += nlit;
+		if(ip == len) break; /* the last sequence has no match */
+
+		if(len - ip < 2) return -1;
+		int offset = (uint8_t)src[ip] | (uint8_t)src[ip + 1] << 8;
+		ip += 2;
+		if(offset == 0 || offset > op) return -1;
+		int mlen = token & 15;
+		if(mlen == 15) {
+			uint8_t b;
+			do {
+				if(ip >= len) return -1;
+				b = (uint8_t)src[ip++];
+				mlen += b;
+			} while(b == 255);
+		}
+		mlen += LZ4_MINMATCH;
+		if(mlen > dstlen - op) return -1;
+		/* matches may overlap their own output, so copy bytewise */
+		for(int i = 0; i < mlen; ++i) dst[op + i] = dst[op - offset + i];
+		op += mlen;
+	}
+	return op;
+}
+
+/*****************************************************************************
+ * helper functions
+ ****************************************************************************/
+uint32_t lz4_read32(const char *p)
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+int lz4_hash(uint32_t seq)
+{
+	return (seq * 2654435761U) >> (32 - LZ4_HASHLOG);
+}
+
+/* Appends a sequence of =nlit= literals followed by a match of =mlen= bytes
+ * at =offset= (no match if =mlen= is zero) to =dst= at =op=.  Returns the
+ * new output position, or -1 if the sequence does not fit. */
+int lz4_sequence(char *dst, int dstlen, int op, const char *lit, int nlit,
+		int offset, int mlen)
+{
+	int ml = mlen ? mlen - LZ4_MINMATCH : 0;
+	int worst = 1 + nlit / 255 + 1 + nlit + 2 + ml / 255 + 1;
+	if(worst > dstlen - op) return -1;
+	int token = op++;
+	dst[token] = (char)((nlit >= 15 ? 15 : nlit) << 4 | (ml >= 15 ? 15 : ml));
+	op = lz4_length(dst, op, nlit);
+	memcpy(dst + op, lit, nlit);
+	op += nlit;
+	if(!mlen) return op;
+	dst[op++] = (char)(offset & 0xFF);
+	dst[op++] = (char)(offset >> 8);
+	return lz4_length(dst, op, ml);
+}
+
+/* Writes the extra bytes of a literal or match length =n=. */
+int lz4_length(char *dst, int op, int n)
+{
+	if(n < 15) return op;
+	n -= 15;
+	while(n >= 255) {
+		dst[op++] = (char)255;
+		n -= 255;
+	}
+	dst[op++] = (char)n;
+	return op;
+}
@@ -0,0 +1,26 @@
+/* This module compresses memory pages with the LZ4 block format (see
+ * lz4_Block_format.md in the LZ4 sources).  It implements a greedy
+ * single-pass compressor with a small hash table, which favors speed over
+ * compression ratio, and a decompressor that checks every length and offset
+ * against its buffers.  Output is readable by any LZ4 block decoder.  The
+ * interface is as follows:
+ *
+ * (1) compress a buffer with =lz4_compress=
+ * (2) get it back with =lz4_decompress=
+ *
+ * Both functions are thread-safe and allocate no memory. */
+
+#ifndef __LZ4_HEADER__
+#define __LZ4_HEADER__
+
+/* This function compresses =len= bytes at =src= into =dst=, which has room
+ * for =dstlen= bytes.  It returns the compressed size, or zero if the output
+ * does not fit in =dst= (i.e., the data is not compressible enough). */
+int lz4_compress(const char *src, int len, char *dst, int dstlen);
+
+/* This function decompresses the =len= bytes at =src= into =dst=, which has
+ * room for =dstlen= bytes.  It returns the decompressed size, or -1 if =src=
+ * is malformed or does not fit in =dst=. */
+int lz4_decompress(const char *src, int len, char *dst, int dstlen);
+
+#endif
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE /* struct ucred, see mmu_client_parent */
 #include <sys/mman.h>
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -15,15 +16,23 @@
 #include <unistd.h>
 
 #include "log.h"
+#include "hist.h"
 
+#include "mmu.h"
 #include "pager.h"
 #include "mmuproto.h"
+#include "trace.h"
 
 #define MMU_MAX_EVENTS 32
 #define MMU_MAX_SOCK 1024
+/* Memory and disk are mapped at their largest, so that resizing them
+ * never moves them */
+#define MMU_MAX_FRAMES 256
+#define MMU_MAX_BLOCKS 1024
+#define MMU_FLAGS_TEMPLATE "mmu.flags.img.XXXXXX"
 
 
-pid_t id2pid[UINT8_MAX];
+pid_t id2pid[UINT8_MAX + 1];
 uint8_t nextid = 0;
 
 /****************************************************************************
@@ -31,22 +40,84 @@ uint8_t nextid = 0;
  ***************************************************************************/
 struct mmu_data {/*{{{*/
 	int running;
-	int npages;
+	volatile sig_atomic_t report; /* 1 asks the main thread to log latencies */
+	int npages; /* frames in the pmem file */
+	int nblocks; /* blocks in the disk */
+	pthread_mutex_t resize; /* serializes RESIZE requests */
 	char *pmem;
 	char *disk;
+	int disk_fd; /* swap file, -1 indicates the disk is in memory */
 	char *pmem_fn;
 	int pmem_fd;
 	int sock;
 	struct mmu_client * sock2client[MMU_MAX_SOCK];
 };/*}}}*/
+#define MMU_MAX_ACKS 64
+#define MMU_ACK_FREE 0
+#define MMU_ACK_WAITING 1
+#define MMU_ACK_DONE 2
+
 struct mmu_client {/*{{{*/
 	int running;
 	int sock;
 	pid_t pid;
 	pthread_t thread;
+	/* `mutex` serializes sends on `sock` and protects the fields
+	 * below; `cond` is broadcast whenever they change. */
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	int exited;
+	int nworkers;
+	int acks[MMU_MAX_ACKS]; /* REMAP and CHPROT messages in flight */
+	uint8_t prot[MMU_PROTO_MAX_PAGES]; /* as last set by the pager */
+	uint8_t *flags; /* shared with the client, see `mmu_page_flags` */
+	int trace_id; /* number in the fault trace, -1 if not recorded */
+	char flags_fn[sizeof(MMU_FLAGS_TEMPLATE)];
+};/*}}}*/
+struct mmu_work {/*{{{*/
+	struct mmu_client *c;
+	union {
+		uint32_t type;
+		struct mmu_proto_extend_req extend;
+		struct mmu_proto_syslog_req syslog;
+		struct mmu_proto_segv_req segv;
+		struct mmu_proto_release_req release;
+		struct mmu_proto_fork_req fork;
+		struct mmu_proto_share_req share;
+		struct mmu_proto_attach_req attach;
+		struct mmu_proto_mmap_req mmap;
+		struct mmu_proto_checkpoint_req checkpoint;
+		struct mmu_proto_restore_req restore;
+		struct mmu_proto_persist_req persist;
+		struct mmu_proto_limit_req limit;
+		struct mmu_proto_stats_req stats;
+		struct mmu_proto_resize_req resize;
+		struct mmu_proto_exit_req exit;
+	} req;
 };/*}}}*/
 static struct mmu_data *mmu = NULL;
+
+/* Fault latency, see `pager_fault` for the phases timed by the pager.
+ * Copies and round trips are only timed when they happen in a fault
+ * (`mmu_faulting` is set).  Histograms outlive `mmu` as workers may
+ * still be running when it is destroyed. */
+static struct {
+	struct hist *fault; /* from SEGV_REQ to SEGV_REP */
+	struct hist *client; /* waiting for REMAP_REQ and CHPROT_REQ */
+	struct hist *copy; /* moving page contents */
+} latency;
+static __thread int mmu_faulting = 0;
+
+/* Fault trace, see trace.h; `file` is NULL unless recording */
+static struct {
+	FILE *file;
+	pthread_mutex_t mutex;
+	uint64_t start;
+	uint8_t recorded[UINT8_MAX + 1]; /* by process number */
+	int wrapped; /* 1 once a process was left out */
+} trace = { NULL, PTHREAD_MUTEX_INITIALIZER, 0, {0}, 0 };
 const char *pmem = NULL;
+const char *swapfile = NULL;
 static size_t PAGESIZE = 0;
 
 /****************************************************************************
@@ -55,8 +126,21 @@ static size_t PAGESIZE = 0;
 static void mmu_destroy(void);
 static void mmu_client_destroy(struct mmu_client *c);
 static void mmu_shutdown_action(int signum, siginfo_t *si, void *context);
+static void mmu_report_action(int signum, siginfo_t *si, void *context);
+static void mmu_copy_done(uint64_t start);
+static int mmu_save_page(const char *page, int fd, off_t offset);
+static void mmu_init_trace(void);
+static void mmu_trace(struct mmu_client *c, int type, int page);
+static int mmu_vaddr_to_page(const void *vaddr);
+static void mmu_stats_dump(void);
+static void mmu_stats_log(const char *who, int id, const struct pager_stats *s);
 static void mmu_accept_loop(void);
 static void * mmu_client_thread(void *vclient);
+static void mmu_block_sigint(void);
+static int mmu_client_ack_begin(struct mmu_client *c);
+static int mmu_client_call(struct mmu_client *c, uint32_t ack, const void *msg, size_t len);
+static void mmu_client_set_prot(struct mmu_client *c, const void *vaddr, int prot);
+static void mmu_client_init_flags(struct mmu_client *c);
 
 int get_pid_id(pid_t pid) {
 	int i = 0;
@@ -72,6 +156,8 @@ static void mmu_init_disk(int nblocks);
 static void mmu_init_pmem(int npages);
 static void mmu_init_sock(void);
 static void mmu_init_sigs(void);
+static void mmu_resize_pmem(int npages);
+static void mmu_resize_disk(int nblocks);
 
 void mmu_init(int npages, int nblocks)/*{{{*/
 {
@@ -80,21 +166,46 @@ void mmu_init(int npages, int nblocks)/*{{{*/
 	mmu = malloc(sizeof(*mmu));
 	if(!mmu) logea(__FILE__, __LINE__, NULL);
 	mmu->running = 1;
+	mmu->report = 0;
 	mmu->npages = npages;
+	mmu->nblocks = nblocks;
+	pthread_mutex_init(&mmu->resize, NULL);
 
 	mmu_init_disk(nblocks);
 	mmu_init_pmem(npages);
 	mmu_init_sock();
 	mmu_init_sigs();
+	mmu_init_trace();
 	memset(mmu->sock2client, 0, MMU_MAX_SOCK*sizeof(mmu->sock2client[0]));
+	latency.fault = hist_create("fault");
+	latency.client = hist_create("fault client");
+	latency.copy = hist_create("fault copy");
 }/*}}}*/
 
 void mmu_init_disk(int nblocks)/*{{{*/
 {
 	size_t disksz = PAGESIZE * nblocks;
-	mmu->disk = malloc(disksz);
-	if(!mmu->disk) logea(__FILE__, __LINE__, NULL);
-	logd(LOG_INFO, "%s: %zu bytes in %d blocks\n", __func__, disksz, nblocks);
+	size_t maxsz = PAGESIZE * MMU_MAX_BLOCKS;
+	int prot = PROT_READ | PROT_WRITE;
+	mmu->disk_fd = -1;
+	if(!swapfile) {
+		mmu->disk = mmap(NULL, maxsz, prot, MAP_PRIVATE | MAP_ANONYMOUS,
+				-1, 0);
+		if(mmu->disk == MAP_FAILED) logea(__FILE__, __LINE__, NULL);
+		logd(LOG_INFO, "%s: %zu bytes in %d blocks\n", __func__, disksz,
+				nblocks);
+		return;
+	}
+	/* blocks written to a shared mapping of the swap file survive the
+	 * MMU; blocks past a shrunk disk are dropped. */
+	mmu->disk_fd = open(swapfile, O_RDWR | O_CREAT, 0600);
+	if(mmu->disk_fd == -1) logea(__FILE__, __LINE__, NULL);
+	if(ftruncate(mmu->disk_fd, disksz) == -1)
+		logea(__FILE__, __LINE__, NULL);
+	mmu->disk = mmap(NULL, maxsz, prot, MAP_SHARED, mmu->disk_fd, 0);
+	if(mmu->disk == MAP_FAILED) logea(__FILE__, __LINE__, NULL);
+	logd(LOG_INFO, "%s: %zu bytes in %d blocks at %s\n", __func__, disksz,
+			nblocks, swapfile);
 }/*}}}*/
 
 void mmu_init_pmem(int npages)/*{{{*/
@@ -112,7 +223,8 @@ void mmu_init_pmem(int npages)/*{{{*/
 	}
 
 	int prot = PROT_READ | PROT_WRITE;
-	mmu->pmem = mmap(NULL, memsz, prot, MAP_SHARED, mmu->pmem_fd, 0);
+	mmu->pmem = mmap(NULL, PAGESIZE * MMU_MAX_FRAMES, prot, MAP_SHARED,
+			mmu->pmem_fd, 0);
 	if(mmu->pmem == MAP_FAILED) logea(__FILE__, __LINE__, NULL);
 	pmem = mmu->pmem;
 	logd(LOG_INFO, "%s: %zu bytes in %d pages\n", __func__, memsz, npages);
@@ -143,8 +255,67 @@ void mmu_init_sigs(void)/*{{{*/
 	new.sa_sigaction = mmu_shutdown_action;
 	sigaction(SIGINT, &new, NULL);
 	logd(LOG_INFO, "%s: SIGINT triggers shutdown\n", __func__);
+	new.sa_sigaction = mmu_report_action;
+	sigaction(SIGUSR1, &new, NULL);
+	logd(LOG_INFO, "%s: SIGUSR1 logs fault latencies\n", __func__);
 }
 /*}}}*/
+
+void mmu_init_trace(void)/*{{{*/
+{
+	const char *path = getenv("MMU_TRACE");
+	if(!path) return;
+	trace.file = fopen(path, "w");
+	if(!trace.file) logea(__FILE__, __LINE__, path);
+	trace.start = hist_now();
+	struct trace_header hdr;
+	memcpy(hdr.magic, TRACE_MAGIC, TRACE_MAGIC_LEN);
+	hdr.pagesize = (uint32_t)PAGESIZE;
+	hdr.nframes = (uint32_t)mmu->npages;
+	hdr.nblocks = (uint32_t)mmu->nblocks;
+	if(fwrite(&hdr, sizeof(hdr), 1, trace.file) != 1)
+		logea(__FILE__, __LINE__, path);
+	logd(LOG_INFO, "%s: recording faults to %s\n", __func__, path);
+}/*}}}*/
+
+void mmu_resize_pmem(int npages)/*{{{*/
+{
+	/* Clients map frames from the file, so it grows and shrinks;
+	 * our mapping covers MMU_MAX_FRAMES and stays put. */
+	if(npages > mmu->npages) {
+		char *fill = malloc(PAGESIZE);
+		if(!fill) logea(__FILE__, __LINE__, NULL);
+		memset(fill, 'z', PAGESIZE);
+		for(int i = mmu->npages; i < npages; ++i) {
+			if(pwrite(mmu->pmem_fd, fill, PAGESIZE, i * PAGESIZE)
+					!= PAGESIZE)
+				logea(__FILE__, __LINE__, NULL);
+		}
+		free(fill);
+	} else if(npages < mmu->npages) {
+		if(ftruncate(mmu->pmem_fd, npages * PAGESIZE) == -1)
+			logea(__FILE__, __LINE__, NULL);
+	}
+	logd(LOG_INFO, "%s: %d pages (was %d)\n", __func__, npages,
+			mmu->npages);
+	mmu->npages = npages;
+}/*}}}*/
+
+void mmu_resize_disk(int nblocks)/*{{{*/
+{
+	if(mmu->disk_fd != -1) {
+		if(ftruncate(mmu->disk_fd, nblocks * PAGESIZE) == -1)
+			logea(__FILE__, __LINE__, NULL);
+	} else if(nblocks < mmu->nblocks) {
+		/* removed blocks read as zeros if added back */
+		madvise(mmu->disk + nblocks * PAGESIZE,
+				(mmu->nblocks - nblocks) * PAGESIZE,
+				MADV_DONTNEED);
+	}
+	logd(LOG_INFO, "%s: %d blocks (was %d)\n", __func__, nblocks,
+			mmu->nblocks);
+	mmu->nblocks = nblocks;
+}/*}}}*/
 /*}}}*/
 
 /****************************************************************************
@@ -158,12 +329,18 @@ void mmu_destroy(void)/*{{{*/
 	free(mmu->pmem_fn);
 	for(int i = 3; i < MMU_MAX_SOCK; ++i) {
 		if(!mmu->sock2client[i]) continue;
-		mmu_client_destroy(mmu->sock2client[i]);
+		shutdown(mmu->sock2client[i]->sock, SHUT_RDWR);
+		unlink(mmu->sock2client[i]->flags_fn);
 	}
-	munmap(mmu->pmem, mmu->npages * PAGESIZE);
-	free(mmu->disk);
+	munmap(mmu->pmem, MMU_MAX_FRAMES * PAGESIZE);
+	munmap(mmu->disk, MMU_MAX_BLOCKS * PAGESIZE);
+	if(mmu->disk_fd != -1) close(mmu->disk_fd);
 	close(mmu->sock);
 	unlink(MMU_PROTO_UNIX_PATH);
+	pthread_mutex_lock(&trace.mutex);
+	if(trace.file) fclose(trace.file);
+	trace.file = NULL;
+	pthread_mutex_unlock(&trace.mutex);
 	free(mmu);
 	mmu = NULL;
 }
@@ -175,6 +352,67 @@ void mmu_shutdown_action(int signum, siginfo_t *si, void *context)/*{{{*/
 	mmu->running = 0;
 }
 /*}}}*/
+
+void mmu_report_action(int signum, siginfo_t *si, void *context)/*{{{*/
+{
+	assert(si->si_signo == SIGUSR1);
+	mmu->report = 1;
+}
+/*}}}*/
+
+void mmu_stats_log(const char *who, int id, const struct pager_stats *s)/*{{{*/
+{
+	logd(LOG_INFO, "stats %s %d: %llu minor %llu major faults, "
+			"%llu zero-fills %llu swap-ins, %llu evictions "
+			"%llu writebacks %llu second chances "
+			"%llu suspensions, %llu resident %llu swap\n", who, id,
+			(unsigned long long)s->minor_faults,
+			(unsigned long long)s->major_faults,
+			(unsigned long long)s->zero_fills,
+			(unsigned long long)s->swap_ins,
+			(unsigned long long)s->evictions,
+			(unsigned long long)s->writebacks,
+			(unsigned long long)s->second_chances,
+			(unsigned long long)s->suspensions,
+			(unsigned long long)s->resident,
+			(unsigned long long)s->swap);
+	if(s->mrc_refs == 0) return;
+	/* misses with 1/8, 2/8, ..., 16/8 of the frames */
+	char curve[PAGER_MRC_POINTS * 21 + 1];
+	int len = 0;
+	for(int i = 0; i < PAGER_MRC_POINTS; ++i)
+		len += snprintf(curve + len, sizeof(curve) - len, " %llu",
+				(unsigned long long)s->mrc_misses[i]);
+	logd(LOG_INFO, "mrc %s %d: %llu refs, misses by eighths of "
+			"frames:%s\n", who, id,
+			(unsigned long long)s->mrc_refs, curve);
+}
+/*}}}*/
+
+void mmu_stats_dump(void)/*{{{*/
+{
+	struct pager_stats stats;
+	for(int i = 3; i < MMU_MAX_SOCK; ++i) {
+		if(!mmu->sock2client[i]) continue;
+		pid_t pid = mmu->sock2client[i]->pid;
+		if(pager_stats(pid, &stats, NULL) == -1) continue;
+		mmu_stats_log("pid", get_pid_id(pid), &stats);
+	}
+	pager_stats(-1, NULL, &stats);
+	mmu_stats_log("total", 0, &stats);
+}
+/*}}}*/
+
+void mmu_block_sigint(void)/*{{{*/
+{
+	/* SIGINT and SIGUSR1 must interrupt accept() in the main thread */
+	sigset_t sigset;
+	if(sigemptyset(&sigset) == -1) logea(__FILE__, __LINE__, NULL);
+	if(sigaddset(&sigset, SIGINT) == -1) logea(__FILE__, __LINE__, NULL);
+	if(sigaddset(&sigset, SIGUSR1) == -1) logea(__FILE__, __LINE__, NULL);
+	pthread_sigmask(SIG_BLOCK, &sigset, NULL);
+}
+/*}}}*/
 /*}}}*/
 
 /****************************************************************************
@@ -187,6 +425,10 @@ void mmu_accept_loop(void)/*{{{*/
 		socklen_t addrlen = sizeof(addr);
 		logd(LOG_DEBUG, "%s: accepting connection\n", __func__);
 		int nsock = accept(mmu->sock, (struct sockaddr *)&addr, &addrlen);
+		if(mmu->report) {
+			mmu->report = 0;
+			hist_log_all(LOG_INFO);
+		}
 		if(nsock == -1) continue;
 		logd(LOG_DEBUG, "%s: sock %d\n", __func__, nsock);
 		logd(LOG_DEBUG, "%s: creating thread\n", __func__);
@@ -196,6 +438,14 @@ void mmu_accept_loop(void)/*{{{*/
 		c->running = 1;
 		c->sock = nsock;
 		c->pid = 0;
+		c->trace_id = -1;
+		c->exited = 0;
+		c->nworkers = 0;
+		memset(c->acks, 0, sizeof(c->acks));
+		memset(c->prot, PROT_NONE, sizeof(c->prot));
+		mmu_client_init_flags(c);
+		pthread_mutex_init(&c->mutex, NULL);
+		pthread_cond_init(&c->cond, NULL);
 		pthread_create(&c->thread, NULL, mmu_client_thread, c);
 		pthread_detach(c->thread);
 	}
@@ -203,15 +453,39 @@ void mmu_accept_loop(void)/*{{{*/
 }/*}}}*/
 
 static void mmu_client_log(const struct mmu_client *c, const char *fname, const char *msg);
+static int mmu_client_send(struct mmu_client *c, const void *msg, size_t len);
+static void mmu_client_disconnect(struct mmu_client *c);
+static void mmu_client_dispatch(struct mmu_client *c, size_t len);
+static void * mmu_client_worker(void *vwork);
+static void mmu_client_ack(struct mmu_client *c, size_t len);
 static void mmu_client_create(struct mmu_client *c);
-static void mmu_client_extend(struct mmu_client *c);
-static void mmu_client_syslog(struct mmu_client *c);
-static void mmu_client_segv(struct mmu_client *c);
-static void mmu_client_exit(struct mmu_client *c);
+static void mmu_client_clone(struct mmu_client *c);
+static pid_t mmu_client_parent(const struct mmu_client *c, pid_t pid);
+static void mmu_client_extend(struct mmu_client *c, const struct mmu_proto_extend_req *req);
+static void mmu_client_syslog(struct mmu_client *c, const struct mmu_proto_syslog_req *req);
+static void mmu_client_segv(struct mmu_client *c, const struct mmu_proto_segv_req *req);
+static void mmu_client_release(struct mmu_client *c, const struct mmu_proto_release_req *req);
+static void mmu_client_fork(struct mmu_client *c, const struct mmu_proto_fork_req *req);
+static void mmu_client_share(struct mmu_client *c, const struct mmu_proto_share_req *req);
+static void mmu_client_attach(struct mmu_client *c, const struct mmu_proto_attach_req *req);
+static void mmu_client_mmap(struct mmu_client *c, const struct mmu_proto_mmap_req *req);
+static void mmu_client_checkpoint(struct mmu_client *c, const struct mmu_proto_checkpoint_req *req);
+static void mmu_client_restore(struct mmu_client *c, const struct mmu_proto_restore_req *req);
+static void mmu_client_persist(struct mmu_client *c, const struct mmu_proto_persist_req *req);
+static void mmu_client_limit(struct mmu_client *c, const struct mmu_proto_limit_req *req);
+static void mmu_client_stats(struct mmu_client *c, const struct mmu_proto_stats_req *req);
+static void mmu_client_resize(struct mmu_client *c, const struct mmu_proto_resize_req *req);
+static void mmu_proto_stats_fill(struct mmu_proto_stats *p, const struct pager_stats *s);
+static void mmu_client_exit(struct mmu_client *c, const struct mmu_proto_exit_req *req);
 
+/* `mmu_client_thread` is the only thread receiving from the client
+ * socket.  It must never block inside the pager: pager calls may
+ * wait on acknowledgements from any client (including this one),
+ * so requests that reach the pager run on worker threads. */
 void * mmu_client_thread(void *vclient)/*{{{*/
 {
 	struct mmu_client *c = vclient;
+	mmu_block_sigint();
 	while(mmu->running && c->running) {
 		mmu_client_log(c, __func__, "recv");
 		uint32_t type;
@@ -220,39 +494,139 @@ void * mmu_client_thread(void *vclient)/*{{{*/
 			mmu_client_log(c, __func__, "breaking loop");
 			break;
 		}
-		if(cnt != sizeof(type)) goto out_client;
+		if(cnt != sizeof(type)) break;
 		switch(type) {
 		case MMU_PROTO_CREATE_REQ:
 			mmu_client_create(c);
 			break;
+		case MMU_PROTO_CLONE_REQ:
+			mmu_client_clone(c);
+			break;
 		case MMU_PROTO_EXTEND_REQ:
-			mmu_client_extend(c);
+			mmu_client_dispatch(c, sizeof(struct mmu_proto_extend_req));
 			break;
 		case MMU_PROTO_SYSLOG_REQ:
-			mmu_client_syslog(c);
+			mmu_client_dispatch(c, sizeof(struct mmu_proto_syslog_req));
 			break;
 		case MMU_PROTO_SEGV_REQ:
-			mmu_client_segv(c);
+			mmu_client_dispatch(c, sizeof(struct mmu_proto_segv_req));
+			break;
+		case MMU_PROTO_RELEASE_REQ:
+			mmu_client_dispatch(c, sizeof(struct mmu_proto_release_req));
+			break;
+		case MMU_PROTO_FORK_REQ:
+			mmu_client_dispatch(c, sizeof(struct mmu_proto_fork_req));
+			break;
+		case MMU_PROTO_SHARE_REQ:
+			mmu_client_dispatch(c, sizeof(struct mmu_proto_share_req));
+			break;
+		case MMU_PROTO_ATTACH_REQ:
+			mmu_client_dispatch(c, sizeof(struct mmu_proto_attach_req));
+			break;
+		case MMU_PROTO_MMAP_REQ:
+			mmu_client_dispatch(c, sizeof(struct mmu_proto_mmap_req));
+			break;
+		case MMU_PROTO_CHECKPOINT_REQ:
+			mmu_client_dispatch(c, sizeof(struct mmu_proto_checkpoint_req));
+			break;
+		case MMU_PROTO_RESTORE_REQ:
+			mmu_client_dispatch(c, sizeof(struct mmu_proto_restore_req));
+			break;
+		case MMU_PROTO_PERSIST_REQ:
+			mmu_client_dispatch(c, sizeof(struct mmu_proto_persist_req));
+			break;
+		case MMU_PROTO_LIMIT_REQ:
+			mmu_client_dispatch(c, sizeof(struct mmu_proto_limit_req));
+			break;
+		case MMU_PROTO_STATS_REQ:
+			mmu_client_dispatch(c, sizeof(struct mmu_proto_stats_req));
+			break;
+		case MMU_PROTO_RESIZE_REQ:
+			mmu_client_dispatch(c, sizeof(struct mmu_proto_resize_req));
 			break;
 		case MMU_PROTO_REMAP_REQ:
+			mmu_client_ack(c, sizeof(struct mmu_proto_remap_req));
+			break;
+		case MMU_PROTO_REMAP_RANGE_REQ:
+			mmu_client_ack(c, sizeof(struct mmu_proto_remap_range_req));
+			break;
 		case MMU_PROTO_CHPROT_REQ:
-			/* these messages are handled by the pager thread */
+			mmu_client_ack(c, sizeof(struct mmu_proto_chprot_req));
 			break;
 		case MMU_PROTO_EXIT_REQ:
-			mmu_client_exit(c);
+			mmu_client_dispatch(c, sizeof(struct mmu_proto_exit_req));
 			break;
 		default:
 			mmu_client_log(c, __func__, "invalid message type");
-			goto out_client;
+			mmu_client_disconnect(c);
 			break;
 		}
 	}
+	mmu_client_destroy(c);
 	mmu_client_log(c, __func__, "finished");
+	pthread_mutex_destroy(&c->mutex);
+	pthread_cond_destroy(&c->cond);
 	free(c);
 	pthread_exit(NULL);
+}/*}}}*/
 
-	out_client:
-	mmu_client_destroy(c);
+void * mmu_client_worker(void *vwork)/*{{{*/
+{
+	struct mmu_work *w = vwork;
+	struct mmu_client *c = w->c;
+	mmu_block_sigint();
+	switch(w->req.type) {
+	case MMU_PROTO_EXTEND_REQ:
+		mmu_client_extend(c, &w->req.extend);
+		break;
+	case MMU_PROTO_SYSLOG_REQ:
+		mmu_client_syslog(c, &w->req.syslog);
+		break;
+	case MMU_PROTO_SEGV_REQ:
+		mmu_client_segv(c, &w->req.segv);
+		break;
+	case MMU_PROTO_RELEASE_REQ:
+		mmu_client_release(c, &w->req.release);
+		break;
+	case MMU_PROTO_FORK_REQ:
+		mmu_client_fork(c, &w->req.fork);
+		break;
+	case MMU_PROTO_SHARE_REQ:
+		mmu_client_share(c, &w->req.share);
+		break;
+	case MMU_PROTO_ATTACH_REQ:
+		mmu_client_attach(c, &w->req.attach);
+		break;
+	case MMU_PROTO_MMAP_REQ:
+		mmu_client_mmap(c, &w->req.mmap);
+		break;
+	case MMU_PROTO_CHECKPOINT_REQ:
+		mmu_client_checkpoint(c, &w->req.checkpoint);
+		break;
+	case MMU_PROTO_RESTORE_REQ:
+		mmu_client_restore(c, &w->req.restore);
+		break;
+	case MMU_PROTO_PERSIST_REQ:
+		mmu_client_persist(c, &w->req.persist);
+		break;
+	case MMU_PROTO_LIMIT_REQ:
+		mmu_client_limit(c, &w->req.limit);
+		break;
+	case MMU_PROTO_STATS_REQ:
+		mmu_client_stats(c, &w->req.stats);
+		break;
+	case MMU_PROTO_RESIZE_REQ:
+		mmu_client_resize(c, &w->req.resize);
+		break;
+	case MMU_PROTO_EXIT_REQ:
+		mmu_client_exit(c, &w->req.exit);
+		break;
+	}
+	free(w);
+	pthread_mutex_lock(&c->mutex);
+	c->nworkers--;
+	pthread_cond_broadcast(&c->cond);
+	pthread_mutex_unlock(&c->mutex);
 	pthread_exit(NULL);
 }/*}}}*/
 
@@ -262,6 +636,59 @@ void mmu_client_log(const struct mmu_client *c, const char *fname, const char *m
 			(int)c->pid, msg);
 }/*}}}*/
 
+int mmu_client_send(struct mmu_client *c, const void *msg, size_t len)/*{{{*/
+{
+	pthread_mutex_lock(&c->mutex);
+	ssize_t cnt = send(c->sock, msg, len, MSG_NOSIGNAL);
+	pthread_mutex_unlock(&c->mutex);
+	return cnt == len ? 0 : -1;
+}/*}}}*/
+
+void mmu_client_disconnect(struct mmu_client *c)/*{{{*/
+{
+	/* wakes up `mmu_client_thread`, which cleans up the client */
+	loge(LOG_WARN, __FILE__, __LINE__);
+	mmu_client_log(c, __func__, "running");
+	shutdown(c->sock, SHUT_RDWR);
+}/*}}}*/
+
+void mmu_client_dispatch(struct mmu_client *c, size_t len)/*{{{*/
+{
+	struct mmu_work *w = malloc(sizeof(*w));
+	if(!w) logea(__FILE__, __LINE__, NULL);
+	w->c = c;
+	if(recv(c->sock, &w->req, len, 0) != len) {
+		free(w);
+		mmu_client_disconnect(c);
+		return;
+	}
+	pthread_mutex_lock(&c->mutex);
+	c->nworkers++;
+	pthread_mutex_unlock(&c->mutex);
+	pthread_t thread;
+	pthread_create(&thread, NULL, mmu_client_worker, w);
+	pthread_detach(thread);
+}/*}}}*/
+
+void mmu_client_ack(struct mmu_client *c, size_t len)/*{{{*/
+{
+	/* REMAP_REQ, REMAP_RANGE_REQ and CHPROT_REQ share the same layout */
+	struct mmu_proto_chprot_req req;
+	assert(len == sizeof(req));
+	if(recv(c->sock, &req, len, 0) != len) {
+		mmu_client_disconnect(c);
+		return;
+	}
+	pthread_mutex_lock(&c->mutex);
+	if(req.id < MMU_MAX_ACKS && c->acks[req.id] == MMU_ACK_WAITING) {
+		c->acks[req.id] = MMU_ACK_DONE;
+		pthread_cond_broadcast(&c->cond);
+	} else {
+		mmu_client_log(c, __func__, "unexpected acknowledgement");
+	}
+	pthread_mutex_unlock(&c->mutex);
+}/*}}}*/
+
 void mmu_client_create(struct mmu_client *c)/*{{{*/
 {
 	char msg[96];
@@ -275,6 +702,7 @@ void mmu_client_create(struct mmu_client *c)/*{{{*/
 	id2pid[nextid++] = c->pid;
 	printf("pager_create pid %d\n", id);
 	pager_create(c->pid);
+	mmu_trace(c, TRACE_CREATE, 0);
 	snprintf(msg, 96, "create pid %d", id);
 	mmu_client_log(c, __func__, msg);
 
@@ -282,50 +710,116 @@ void mmu_client_create(struct mmu_client *c)/*{{{*/
 	rep.type = MMU_PROTO_CREATE_REP;
 	memset(rep.pmem_fn, '\0', MMU_PROTO_PATH_MAX);
 	strncat(rep.pmem_fn, mmu->pmem_fn, MMU_PROTO_PATH_MAX);
-	if(send(c->sock, &rep, sizeof(rep), 0) != sizeof(rep))
+	memset(rep.flags_fn, '\0', MMU_PROTO_PATH_MAX);
+	strncat(rep.flags_fn, c->flags_fn, MMU_PROTO_PATH_MAX - 1);
+	if(mmu_client_send(c, &rep, sizeof(rep)) == -1)
 		goto out_client;
 	return;
 
 	out_client:
-	mmu_client_destroy(c);
+	mmu_client_disconnect(c);
 }/*}}}*/
 
-void mmu_client_extend(struct mmu_client *c)/*{{{*/
+void mmu_client_clone(struct mmu_client *c)/*{{{*/
 {
 	char msg[96];
-	struct mmu_proto_extend_req req;
+	struct mmu_proto_clone_req req;
 	if(recv(c->sock, &req, sizeof(req), 0) != sizeof(req))
 		goto out_client;
-	assert(req.type == MMU_PROTO_EXTEND_REQ);
+	assert(req.type == MMU_PROTO_CLONE_REQ);
+
+	int id = nextid;
+	id2pid[nextid++] = (pid_t)req.pid;
+	printf("pager_create_forked pid %d\n", id);
+	/* the pager looks up the clone's page flags by pid */
+	c->pid = (pid_t)req.pid;
+	int status = pager_create_forked((pid_t)req.pid,
+			mmu_client_parent(c, (pid_t)req.pid), req.token);
+	if(status != 0) c->pid = 0;
+	snprintf(msg, 96, "clone pid %d retcode %d", id, status);
+	mmu_client_log(c, __func__, msg);
+
+	struct mmu_proto_clone_rep rep;
+	rep.type = MMU_PROTO_CLONE_REP;
+	rep.retcode = (uint32_t)status;
+	memset(rep.pmem_fn, '\0', MMU_PROTO_PATH_MAX);
+	strncat(rep.pmem_fn, mmu->pmem_fn, MMU_PROTO_PATH_MAX - 1);
+	memset(rep.flags_fn, '\0', MMU_PROTO_PATH_MAX);
+	strncat(rep.flags_fn, c->flags_fn, MMU_PROTO_PATH_MAX - 1);
+	if(mmu_client_send(c, &rep, sizeof(rep)) == -1)
+		goto out_client;
+	return;
+
+	out_client:
+	mmu_client_disconnect(c);
+}/*}}}*/
+
+pid_t mmu_client_parent(const struct mmu_client *c, pid_t pid)/*{{{*/
+{
+	/* the kernel vouches for the peer's pid, so a client cannot claim
+	 * a clone for a process it did not fork. */
+	struct ucred cred;
+	socklen_t len = sizeof(cred);
+	if(getsockopt(c->sock, SOL_SOCKET, SO_PEERCRED, &cred, &len) == -1
+			|| cred.pid != pid)
+		return -1;
+	char path[64], buf[512];
+	snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+	int fd = open(path, O_RDONLY);
+	if(fd == -1) return -1;
+	ssize_t n = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if(n <= 0) return -1;
+	buf[n] = '\0';
+	/* the command name in parentheses may hold spaces */
+	char *end = strrchr(buf, ')');
+	int ppid;
+	if(end == NULL || sscanf(end + 1, " %*c %d", &ppid) != 1)
+		return -1;
+	return (pid_t)ppid;
+}/*}}}*/
+
+void mmu_client_extend(struct mmu_client *c, const struct mmu_proto_extend_req *req)/*{{{*/
+{
+	char msg[96];
+	assert(req->type == MMU_PROTO_EXTEND_REQ);
 
 	int id = get_pid_id(c->pid);
-	void *vaddr = pager_extend(c->pid);
-	printf("pager_extend pid %d vaddr %p\n", id, vaddr);
-	snprintf(msg, 96, "extend vaddr %p", vaddr);
+	int npages = (int)req->npages;
+	void *vaddr;
+	if(npages == 1) {
+		vaddr = pager_extend(c->pid);
+		printf("pager_extend pid %d vaddr %p\n", id, vaddr);
+	} else {
+		vaddr = pager_extend_range(c->pid, npages);
+		printf("pager_extend_range pid %d npages %d vaddr %p\n", id,
+				npages, vaddr);
+	}
+	snprintf(msg, 96, "extend npages %d vaddr %p", npages, vaddr);
 	mmu_client_log(c, __func__, msg);
+	for(int i = 0; vaddr && i < npages; ++i)
+		mmu_trace(c, TRACE_EXTEND, mmu_vaddr_to_page(vaddr) + i);
 
 	struct mmu_proto_extend_rep rep;
 	rep.type = MMU_PROTO_EXTEND_REP;
+	rep.id = req->id;
 	rep.vaddr = (intptr_t)vaddr;
-	if(send(c->sock, &rep, sizeof(rep), 0) != sizeof(rep))
+	if(mmu_client_send(c, &rep, sizeof(rep)) == -1)
 		goto out_client;
 	return;
 
 	out_client:
-	mmu_client_destroy(c);
+	mmu_client_disconnect(c);
 }/*}}}*/
 
-void mmu_client_syslog(struct mmu_client *c)/*{{{*/
+void mmu_client_syslog(struct mmu_client *c, const struct mmu_proto_syslog_req *req)/*{{{*/
 {
 	char msg[96];
-	struct mmu_proto_syslog_req req;
-	if(recv(c->sock, &req, sizeof(req), 0) != sizeof(req))
-		goto out_client;
-	assert(req.type == MMU_PROTO_SYSLOG_REQ);
+	assert(req->type == MMU_PROTO_SYSLOG_REQ);
 
-	assert(req.addr < UINTPTR_MAX);
-	void *vaddr = (void *)(uintptr_t)req.addr;
-	size_t len = (size_t)req.len;
+	assert(req->addr < UINTPTR_MAX);
+	void *vaddr = (void *)(uintptr_t)req->addr;
+	size_t len = (size_t)req->len;
 	int id = get_pid_id(c->pid);
 	printf("pager_syslog pid %d %p\n", id, vaddr);
 	int status = pager_syslog(c->pid, vaddr, len);
@@ -334,78 +828,463 @@ void mmu_client_syslog(struct mmu_client *c)/*{{{*/
 
 	struct mmu_proto_syslog_rep rep;
 	rep.type = MMU_PROTO_SYSLOG_REP;
+	rep.id = req->id;
 	rep.retcode = (uint32_t)status;
-	if(send(c->sock, &rep, sizeof(rep), 0) != sizeof(rep))
+	if(mmu_client_send(c, &rep, sizeof(rep)) == -1)
 		goto out_client;
 	return;
 
 	out_client:
-	mmu_client_destroy(c);
+	mmu_client_disconnect(c);
 }/*}}}*/
 
-void mmu_client_segv(struct mmu_client *c)/*{{{*/
+void mmu_client_segv(struct mmu_client *c, const struct mmu_proto_segv_req *req)/*{{{*/
 {
 	char msg[96];
-	struct mmu_proto_segv_req req;
-	if(recv(c->sock, &req, sizeof(req), 0) != sizeof(req))
-		goto out_client;
-	assert(req.type == MMU_PROTO_SEGV_REQ);
+	assert(req->type == MMU_PROTO_SEGV_REQ);
 
-	assert(req.addr < UINTPTR_MAX);
-	void *vaddr = (void *)(uintptr_t)req.addr;
-	int code = (int)req.code;
+	assert(req->addr < UINTPTR_MAX);
+	void *vaddr = (void *)(uintptr_t)req->addr;
+	int code = (int)req->code;
 	snprintf(msg, 96, "vaddr %p code %d", vaddr, code);
 	mmu_client_log(c, __func__, msg);
 
 	int id = get_pid_id(c->pid);
 	printf("pager_fault pid %d vaddr %p\n", id, vaddr);
-	pager_fault(c->pid, vaddr);
+	/* Clients that cannot decode the access leave the pager to assume
+	 * a read; faults on readable pages can only be writes, though */
+	int write = req->write == 1;
+	int page = mmu_vaddr_to_page(vaddr);
+	if(page >= 0 && page < MMU_PROTO_MAX_PAGES) {
+		if(req->write == -1)
+			write = c->prot[page] & PROT_READ;
+		mmu_trace(c, write ? TRACE_WRITE : TRACE_READ, page);
+	}
+	uint64_t start = hist_now();
+	mmu_faulting = 1;
+	pager_fault_access(c->pid, vaddr, write);
+	mmu_faulting = 0;
+	hist_record_since(latency.fault, start);
 
 	struct mmu_proto_segv_rep rep;
 	rep.type = MMU_PROTO_SEGV_REP;
-	if(send(c->sock, &rep, sizeof(rep), 0) != sizeof(rep))
+	rep.id = req->id;
+	if(mmu_client_send(c, &rep, sizeof(rep)) == -1)
 		goto out_client;
 	return;
 
 	out_client:
-	mmu_client_destroy(c);
+	mmu_client_disconnect(c);
 }/*}}}*/
 
-void mmu_client_exit(struct mmu_client *c)/*{{{*/
+void mmu_client_release(struct mmu_client *c, const struct mmu_proto_release_req *req)/*{{{*/
 {
-	struct mmu_proto_exit_req req;
-	if(recv(c->sock, &req, sizeof(req), 0) != sizeof(req))
+	char msg[96];
+	assert(req->type == MMU_PROTO_RELEASE_REQ);
+
+	assert(req->addr < UINTPTR_MAX);
+	void *vaddr = (void *)(uintptr_t)req->addr;
+	int npages = (int)req->npages;
+	int id = get_pid_id(c->pid);
+	printf("pager_release pid %d vaddr %p npages %d\n", id, vaddr, npages);
+	int status = pager_release(c->pid, vaddr, npages);
+	snprintf(msg, 96, "vaddr %p npages %d retcode %d", vaddr, npages,
+			status);
+	mmu_client_log(c, __func__, msg);
+
+	struct mmu_proto_release_rep rep;
+	rep.type = MMU_PROTO_RELEASE_REP;
+	rep.id = req->id;
+	rep.retcode = (uint32_t)status;
+	if(mmu_client_send(c, &rep, sizeof(rep)) == -1)
+		goto out_client;
+	return;
+
+	out_client:
+	mmu_client_disconnect(c);
+}/*}}}*/
+
+void mmu_client_fork(struct mmu_client *c, const struct mmu_proto_fork_req *req)/*{{{*/
+{
+	char msg[96];
+	assert(req->type == MMU_PROTO_FORK_REQ);
+
+	int id = get_pid_id(c->pid);
+	uint64_t token = pager_fork(c->pid);
+	int error = token == 0 ? errno : 0;
+	printf("pager_fork pid %d\n", id);
+	snprintf(msg, 96, "fork error %d", error);
+	mmu_client_log(c, __func__, msg);
+
+	struct mmu_proto_fork_rep rep;
+	rep.type = MMU_PROTO_FORK_REP;
+	rep.id = req->id;
+	rep.error = (uint32_t)error;
+	rep.token = token;
+	if(mmu_client_send(c, &rep, sizeof(rep)) == -1)
+		goto out_client;
+	return;
+
+	out_client:
+	mmu_client_disconnect(c);
+}/*}}}*/
+
+void mmu_client_share(struct mmu_client *c, const struct mmu_proto_share_req *req)/*{{{*/
+{
+	char msg[96];
+	char name[MMU_PROTO_NAME_MAX];
+	assert(req->type == MMU_PROTO_SHARE_REQ);
+
+	memcpy(name, req->name, MMU_PROTO_NAME_MAX);
+	name[MMU_PROTO_NAME_MAX - 1] = '\0';
+	int npages = (int)req->npages;
+	int id = get_pid_id(c->pid);
+	errno = 0;
+	void *vaddr = pager_share(c->pid, name, npages);
+	int error = vaddr ? 0 : errno;
+	printf("pager_share pid %d name %s npages %d vaddr %p\n", id, name,
+			npages, vaddr);
+	snprintf(msg, 96, "share npages %d vaddr %p error %d", npages, vaddr,
+			error);
+	mmu_client_log(c, __func__, msg);
+
+	struct mmu_proto_share_rep rep;
+	rep.type = MMU_PROTO_SHARE_REP;
+	rep.id = req->id;
+	rep.error = (int32_t)error;
+	rep.vaddr = (uint64_t)(uintptr_t)vaddr;
+	if(mmu_client_send(c, &rep, sizeof(rep)) == -1)
+		goto out_client;
+	return;
+
+	out_client:
+	mmu_client_disconnect(c);
+}/*}}}*/
+
+void mmu_client_attach(struct mmu_client *c, const struct mmu_proto_attach_req *req)/*{{{*/
+{
+	char msg[96];
+	char name[MMU_PROTO_NAME_MAX];
+	assert(req->type == MMU_PROTO_ATTACH_REQ);
+
+	memcpy(name, req->name, MMU_PROTO_NAME_MAX);
+	name[MMU_PROTO_NAME_MAX - 1] = '\0';
+	int npages = 0;
+	int id = get_pid_id(c->pid);
+	errno = 0;
+	void *vaddr = pager_attach(c->pid, name, &npages);
+	int error = vaddr ? 0 : errno;
+	printf("pager_attach pid %d name %s npages %d vaddr %p\n", id, name,
+			npages, vaddr);
+	snprintf(msg, 96, "attach npages %d vaddr %p error %d", npages, vaddr,
+			error);
+	mmu_client_log(c, __func__, msg);
+
+	struct mmu_proto_attach_rep rep;
+	rep.type = MMU_PROTO_ATTACH_REP;
+	rep.id = req->id;
+	rep.error = (int32_t)error;
+	rep.npages = (uint32_t)npages;
+	rep.vaddr = (uint64_t)(uintptr_t)vaddr;
+	if(mmu_client_send(c, &rep, sizeof(rep)) == -1)
+		goto out_client;
+	return;
+
+	out_client:
+	mmu_client_disconnect(c);
+}/*}}}*/
+
+void mmu_client_mmap(struct mmu_client *c, const struct mmu_proto_mmap_req *req)/*{{{*/
+{
+	char msg[96];
+	char path[MMU_PROTO_FILE_MAX];
+	assert(req->type == MMU_PROTO_MMAP_REQ);
+
+	memcpy(path, req->path, MMU_PROTO_FILE_MAX);
+	path[MMU_PROTO_FILE_MAX - 1] = '\0';
+	off_t offset = (off_t)req->offset;
+	int npages = (int)req->npages;
+	int id = get_pid_id(c->pid);
+	errno = 0;
+	void *vaddr = pager_mmap(c->pid, path, offset, npages);
+	int error = vaddr ? 0 : errno;
+	/* only the file name: paths depend on where tests run */
+	const char *base = strrchr(path, '/');
+	printf("pager_mmap pid %d file %s offset %lld npages %d vaddr %p\n",
+			id, base ? base + 1 : path, (long long)offset, npages, vaddr);
+	snprintf(msg, 96, "mmap npages %d vaddr %p error %d", npages, vaddr,
+			error);
+	mmu_client_log(c, __func__, msg);
+
+	struct mmu_proto_mmap_rep rep;
+	rep.type = MMU_PROTO_MMAP_REP;
+	rep.id = req->id;
+	rep.error = (int32_t)error;
+	rep.vaddr = (uint64_t)(uintptr_t)vaddr;
+	if(mmu_client_send(c, &rep, sizeof(rep)) == -1)
+		goto out_client;
+	return;
+
+	out_client:
+	mmu_client_disconnect(c);
+}/*}}}*/
+
+void mmu_client_checkpoint(struct mmu_client *c, const struct mmu_proto_checkpoint_req *req)/*{{{*/
+{
+	char msg[96];
+	char path[MMU_PROTO_FILE_MAX];
+	assert(req->type == MMU_PROTO_CHECKPOINT_REQ);
+
+	memcpy(path, req->path, MMU_PROTO_FILE_MAX);
+	path[MMU_PROTO_FILE_MAX - 1] = '\0';
+	int id = get_pid_id(c->pid);
+	const char *base = strrchr(path, '/');
+	printf("pager_checkpoint pid %d file %s\n", id, base ? base + 1 : path);
+	int status = pager_checkpoint(c->pid, path);
+	int error = status == 0 ? 0 : errno;
+	snprintf(msg, 96, "checkpoint retcode %d error %d", status, error);
+	mmu_client_log(c, __func__, msg);
+
+	struct mmu_proto_checkpoint_rep rep;
+	rep.type = MMU_PROTO_CHECKPOINT_REP;
+	rep.id = req->id;
+	rep.error = (int32_t)error;
+	if(mmu_client_send(c, &rep, sizeof(rep)) == -1)
+		goto out_client;
+	return;
+
+	out_client:
+	mmu_client_disconnect(c);
+}/*}}}*/
+
+void mmu_client_restore(struct mmu_client *c, const struct mmu_proto_restore_req *req)/*{{{*/
+{
+	char msg[96];
+	char path[MMU_PROTO_FILE_MAX];
+	assert(req->type == MMU_PROTO_RESTORE_REQ);
+
+	memcpy(path, req->path, MMU_PROTO_FILE_MAX);
+	path[MMU_PROTO_FILE_MAX - 1] = '\0';
+	int id = get_pid_id(c->pid);
+	const char *base = strrchr(path, '/');
+	printf("pager_restore pid %d file %s\n", id, base ? base + 1 : path);
+	int status = pager_restore(c->pid, path);
+	int error = status == 0 ? 0 : errno;
+	snprintf(msg, 96, "restore retcode %d error %d", status, error);
+	mmu_client_log(c, __func__, msg);
+
+	struct mmu_proto_restore_rep rep;
+	rep.type = MMU_PROTO_RESTORE_REP;
+	rep.id = req->id;
+	rep.error = (int32_t)error;
+	if(mmu_client_send(c, &rep, sizeof(rep)) == -1)
+		goto out_client;
+	return;
+
+	out_client:
+	mmu_client_disconnect(c);
+}/*}}}*/
+
+void mmu_client_persist(struct mmu_client *c, const struct mmu_proto_persist_req *req)/*{{{*/
+{
+	char msg[96];
+	char key[MMU_PROTO_NAME_MAX];
+	char valid[MMU_PROTO_MAX_PAGES];
+	assert(req->type == MMU_PROTO_PERSIST_REQ);
+
+	memcpy(key, req->key, MMU_PROTO_NAME_MAX);
+	key[MMU_PROTO_NAME_MAX - 1] = '\0';
+	int id = get_pid_id(c->pid);
+	int status;
+	memset(valid, 0, MMU_PROTO_MAX_PAGES);
+	if(key[0] == '\0') {
+		printf("pager_unpersist pid %d\n", id);
+		status = pager_unpersist(c->pid);
+	} else {
+		printf("pager_persist pid %d key %s\n", id, key);
+		status = pager_persist(c->pid, key, valid);
+	}
+	int error = status == 0 ? 0 : errno;
+	snprintf(msg, 96, "persist retcode %d error %d", status, error);
+	mmu_client_log(c, __func__, msg);
+
+	struct mmu_proto_persist_rep rep;
+	rep.type = MMU_PROTO_PERSIST_REP;
+	rep.id = req->id;
+	rep.error = (int32_t)error;
+	memset(rep.pages, 0, sizeof(rep.pages));
+	for(int i = 0; i < MMU_PROTO_MAX_PAGES; ++i) {
+		if(valid[i]) rep.pages[i / 8] |= 1 << (i % 8);
+	}
+	if(mmu_client_send(c, &rep, sizeof(rep)) == -1)
+		goto out_client;
+	return;
+
+	out_client:
+	mmu_client_disconnect(c);
+}/*}}}*/
+
+void mmu_client_limit(struct mmu_client *c, const struct mmu_proto_limit_req *req)/*{{{*/
+{
+	char msg[96];
+	assert(req->type == MMU_PROTO_LIMIT_REQ);
+
+	int id = get_pid_id(c->pid);
+	printf("pager_limit pid %d min %d max %d blocks %d local %d\n", id,
+			(int)req->min_frames, (int)req->max_frames,
+			(int)req->max_blocks, (int)req->local);
+	int status = pager_limit(c->pid, req->min_frames, req->max_frames,
+			req->max_blocks, req->local);
+	int error = status == 0 ? 0 : errno;
+	snprintf(msg, 96, "limit retcode %d error %d", status, error);
+	mmu_client_log(c, __func__, msg);
+
+	struct mmu_proto_limit_rep rep;
+	rep.type = MMU_PROTO_LIMIT_REP;
+	rep.id = req->id;
+	rep.error = (int32_t)error;
+	if(mmu_client_send(c, &rep, sizeof(rep)) == -1)
 		goto out_client;
+	return;
+
+	out_client:
+	mmu_client_disconnect(c);
+}/*}}}*/
+
+void mmu_proto_stats_fill(struct mmu_proto_stats *p, const struct pager_stats *s)/*{{{*/
+{
+	p->minor_faults = s->minor_faults;
+	p->major_faults = s->major_faults;
+	p->zero_fills = s->zero_fills;
+	p->swap_ins = s->swap_ins;
+	p->evictions = s->evictions;
+	p->writebacks = s->writebacks;
+	p->second_chances = s->second_chances;
+	p->suspensions = s->suspensions;
+	p->resident = s->resident;
+	p->swap = s->swap;
+	p->mrc_refs = s->mrc_refs;
+	for(int i = 0; i < MMU_PROTO_MRC_POINTS; ++i)
+		p->mrc_misses[i] = s->mrc_misses[i];
+}/*}}}*/
+
+void mmu_client_stats(struct mmu_client *c, const struct mmu_proto_stats_req *req)/*{{{*/
+{
+	char msg[96];
+	assert(req->type == MMU_PROTO_STATS_REQ);
+
+	int id = get_pid_id(c->pid);
+	printf("pager_stats pid %d\n", id);
+	struct pager_stats proc, total;
+	int status = pager_stats(c->pid, &proc, &total);
+	int error = status == 0 ? 0 : errno;
+	snprintf(msg, 96, "stats retcode %d error %d", status, error);
+	mmu_client_log(c, __func__, msg);
+
+	struct mmu_proto_stats_rep rep;
+	memset(&rep, 0, sizeof(rep));
+	rep.type = MMU_PROTO_STATS_REP;
+	rep.id = req->id;
+	rep.error = (int32_t)error;
+	if(status == 0) {
+		mmu_proto_stats_fill(&rep.proc, &proc);
+		mmu_proto_stats_fill(&rep.total, &total);
+	}
+	if(mmu_client_send(c, &rep, sizeof(rep)) == -1)
+		goto out_client;
+	return;
+
+	out_client:
+	mmu_client_disconnect(c);
+}/*}}}*/
+
+void mmu_client_resize(struct mmu_client *c, const struct mmu_proto_resize_req *req)/*{{{*/
+{
+	char msg[96];
+	assert(req->type == MMU_PROTO_RESIZE_REQ);
+
+	int id = get_pid_id(c->pid);
+	printf("pager_resize pid %d nframes %d nblocks %d\n", id,
+			(int)req->nframes, (int)req->nblocks);
+	pthread_mutex_lock(&mmu->resize);
+	int npages = req->nframes != 0 ? req->nframes : mmu->npages;
+	int nblocks = req->nblocks != 0 ? req->nblocks : mmu->nblocks;
+	int status = -1;
+	int error = EINVAL;
+	if(npages >= 1 && npages <= MMU_MAX_FRAMES
+			&& nblocks >= 2 && nblocks <= MMU_MAX_BLOCKS) {
+		/* The pager uses added frames and blocks as soon as it
+		 * knows them, and is done with removed ones when it
+		 * returns. */
+		int oldpages = mmu->npages;
+		int oldblocks = mmu->nblocks;
+		if(npages > oldpages) mmu_resize_pmem(npages);
+		if(nblocks > oldblocks) mmu_resize_disk(nblocks);
+		status = pager_resize(npages, nblocks);
+		error = status == 0 ? 0 : errno;
+		if(status != 0) {
+			npages = oldpages;
+			nblocks = oldblocks;
+		}
+		if(npages != mmu->npages) mmu_resize_pmem(npages);
+		if(nblocks != mmu->nblocks) mmu_resize_disk(nblocks);
+	}
+	pthread_mutex_unlock(&mmu->resize);
+	snprintf(msg, 96, "resize retcode %d error %d", status, error);
+	mmu_client_log(c, __func__, msg);
+
+	struct mmu_proto_resize_rep rep;
+	rep.type = MMU_PROTO_RESIZE_REP;
+	rep.id = req->id;
+	rep.error = (int32_t)error;
+	if(mmu_client_send(c, &rep, sizeof(rep)) == -1)
+		goto out_client;
+	return;
+
+	out_client:
+	mmu_client_disconnect(c);
+}/*}}}*/
+
+void mmu_client_exit(struct mmu_client *c, const struct mmu_proto_exit_req *req)/*{{{*/
+{
 	mmu_client_log(c, __func__, "exiting cleanly");
-	assert(req.type == MMU_PROTO_EXIT_REQ);
+	assert(req->type == MMU_PROTO_EXIT_REQ);
 	assert(c->pid);
 	int id = get_pid_id(c->pid);
 	printf("pager_destroy pid %d\n", id);
 	pager_destroy(c->pid);
+	mmu_trace(c, TRACE_DESTROY, 0);
 
-	struct mmu_proto_segv_rep rep;
-	rep.type = MMU_PROTO_EXIT_REP;
-	send(c->sock, &rep, sizeof(rep), 0); /* ignoring return value */
-
-	mmu->sock2client[c->sock] = NULL;
-	c->running = 0;
-	close(c->sock);
-	return;
+	pthread_mutex_lock(&c->mutex);
+	c->exited = 1;
+	pthread_mutex_unlock(&c->mutex);
 
-	out_client:
-	mmu_client_destroy(c);
+	struct mmu_proto_exit_rep rep;
+	rep.type = MMU_PROTO_EXIT_REP;
+	mmu_client_send(c, &rep, sizeof(rep)); /* ignoring return value */
+	shutdown(c->sock, SHUT_RDWR);
 }/*}}}*/
 
 void mmu_client_destroy(struct mmu_client *c)/*{{{*/
 {
-	loge(LOG_WARN, __FILE__, __LINE__);
 	mmu_client_log(c, __func__, "running");
-	mmu->sock2client[c->sock] = NULL;
+	pthread_mutex_lock(&c->mutex);
 	c->running = 0;
-	close(c->sock);
-	if(c->pid) { /* may get here before CREATE_REQ happens */
+	/* fail pending acknowledgements so workers leave the pager */
+	pthread_cond_broadcast(&c->cond);
+	while(c->nworkers > 0)
+		pthread_cond_wait(&c->cond, &c->mutex);
+	int exited = c->exited;
+	pthread_mutex_unlock(&c->mutex);
+	if(c->pid && !exited) { /* may get here before CREATE_REQ happens */
+		loge(LOG_WARN, __FILE__, __LINE__);
 		pager_destroy(c->pid);
+		mmu_trace(c, TRACE_DESTROY, 0);
 	}
+	mmu->sock2client[c->sock] = NULL;
+	close(c->sock);
+	munmap(c->flags, MMU_PROTO_MAX_PAGES);
+	unlink(c->flags_fn);
 }/*}}}*/
 /*}}}*/
 
@@ -424,11 +1303,119 @@ struct mmu_client * mmu_client_search(pid_t pid)/*{{{*/
 	exit(EXIT_FAILURE);
 }/*}}}*/
 
+uint8_t * mmu_page_flags(pid_t pid)/*{{{*/
+{
+	/* unlike `mmu_client_search`, a missing client is no error */
+	for(int i = 3; i < MMU_MAX_SOCK; ++i) {
+		if(!mmu->sock2client[i]) continue;
+		if(mmu->sock2client[i]->pid == pid)
+			return mmu->sock2client[i]->flags;
+	}
+	return NULL;
+}/*}}}*/
+
+int mmu_client_ack_begin(struct mmu_client *c)/*{{{*/
+{
+	pthread_mutex_lock(&c->mutex);
+	while(c->running) {
+		for(int i = 0; i < MMU_MAX_ACKS; ++i) {
+			if(c->acks[i] != MMU_ACK_FREE) continue;
+			c->acks[i] = MMU_ACK_WAITING;
+			pthread_mutex_unlock(&c->mutex);
+			return i;
+		}
+		pthread_cond_wait(&c->cond, &c->mutex);
+	}
+	pthread_mutex_unlock(&c->mutex);
+	return -1;
+}/*}}}*/
+
+int mmu_client_call(struct mmu_client *c, uint32_t ack, const void *msg, size_t len)/*{{{*/
+{
+	int status = -1;
+	uint64_t start = hist_now();
+	pthread_mutex_lock(&c->mutex);
+	if(send(c->sock, msg, len, MSG_NOSIGNAL) == len) {
+		while(c->running && c->acks[ack] == MMU_ACK_WAITING)
+			pthread_cond_wait(&c->cond, &c->mutex);
+		if(c->acks[ack] == MMU_ACK_DONE) status = 0;
+	}
+	c->acks[ack] = MMU_ACK_FREE;
+	pthread_cond_broadcast(&c->cond);
+	pthread_mutex_unlock(&c->mutex);
+	if(mmu_faulting) hist_record_since(latency.client, start);
+	return status;
+}/*}}}*/
+
+void mmu_client_set_prot(struct mmu_client *c, const void *vaddr, int prot)/*{{{*/
+{
+	int page = mmu_vaddr_to_page(vaddr);
+	if(page < 0 || page >= MMU_PROTO_MAX_PAGES) return;
+	c->prot[page] = (uint8_t)prot;
+	/* before the client is told, so it cannot restore the page's old
+	 * protection afterwards */
+	__atomic_store_n(&c->flags[page], 0, __ATOMIC_SEQ_CST);
+}/*}}}*/
+
+/* The page flags live in a file of their own so that the client can
+ * map them; see `mmu_page_flags`. */
+void mmu_client_init_flags(struct mmu_client *c)/*{{{*/
+{
+	strcpy(c->flags_fn, MMU_FLAGS_TEMPLATE);
+	int fd = mkstemp(c->flags_fn);
+	if(fd == -1) logea(__FILE__, __LINE__, NULL);
+	if(ftruncate(fd, MMU_PROTO_MAX_PAGES) == -1)
+		logea(__FILE__, __LINE__, NULL);
+	int prot = PROT_READ | PROT_WRITE;
+	c->flags = mmap(NULL, MMU_PROTO_MAX_PAGES, prot, MAP_SHARED, fd, 0);
+	if(c->flags == MAP_FAILED) logea(__FILE__, __LINE__, NULL);
+	close(fd);
+	logd(LOG_DEBUG, "%s: sock %d path %s\n", __func__, c->sock,
+			c->flags_fn);
+}/*}}}*/
+
+int mmu_vaddr_to_page(const void *vaddr)/*{{{*/
+{
+	return (int)(((intptr_t)vaddr - UVM_BASEADDR) / (intptr_t)PAGESIZE);
+}/*}}}*/
+
+void mmu_trace(struct mmu_client *c, int type, int page)/*{{{*/
+{
+	if(!trace.file) return;
+	pthread_mutex_lock(&trace.mutex);
+	if(type == TRACE_CREATE) {
+		/* process numbers wrap around after 256 processes; records of
+		 * a process reusing a number would alias the first one's. */
+		int id = get_pid_id(c->pid);
+		if(!trace.recorded[id]) {
+			trace.recorded[id] = 1;
+			c->trace_id = id;
+		} else if(!trace.wrapped) {
+			trace.wrapped = 1;
+			logd(LOG_WARN, "%s: more than %d processes, "
+					"not recording the later ones\n", __func__,
+					UINT8_MAX + 1);
+		}
+	}
+	if(c->trace_id != -1) {
+		struct trace_record rec;
+		rec.time = hist_now() - trace.start;
+		rec.pid = (uint8_t)c->trace_id;
+		rec.type = (uint8_t)type;
+		rec.page = (uint16_t)page;
+		if(trace.file && fwrite(&rec, sizeof(rec), 1, trace.file) != 1)
+			loge(LOG_ERROR, __FILE__, __LINE__);
+	}
+	pthread_mutex_unlock(&trace.mutex);
+}/*}}}*/
+
 void mmu_zero_fill(int frame)/*{{{*/
 {
 	printf("%s frame %u\n", __func__, frame);
 	logd(LOG_DEBUG, "%s frame %u\n", __func__, frame);
+	uint64_t start = hist_now();
 	memset(mmu->pmem + (PAGESIZE*frame), '0', PAGESIZE);
+	mmu_copy_done(start);
 }/*}}}*/
 
 void mmu_resident(pid_t pid, void *vaddr, int frame, int prot)/*{{{*/
@@ -439,35 +1426,75 @@ void mmu_resident(pid_t pid, void *vaddr, int frame, int prot)/*{{{*/
 	logd(LOG_DEBUG, "%s pid %d vaddr %p prot %d frame %u\n", __func__,
 			id, vaddr, prot, frame);
 	struct mmu_client *c = mmu_client_search(pid);
+	int ack = mmu_client_ack_begin(c);
+	if(ack == -1)
+		goto out_client;
+	mmu_client_set_prot(c, vaddr, prot);
 	struct mmu_proto_remap_rep rep;
 	rep.type = MMU_PROTO_REMAP_REP;
+	rep.id = (uint32_t)ack;
 	rep.prot = (int32_t)prot;
 	rep.offset = (uint64_t)(PAGESIZE * frame);
 	rep.vaddr = (intptr_t)vaddr;
-	if(send(c->sock, &rep, sizeof(rep), 0) != sizeof(rep))
-		goto out_client;
 
 	/* We need these functions to wait for the application to
 	 * effect the protection change before we return to the
-	 * pager.  This loop is necessary because mmu_client_thread
-	 * is already in the pager and blocked here (so we cannot
-	 * wait on a condition variable to be signaled forward as
-	 * there is no one else to recv the REMAP_REQ message).  An
-	 * alternative approach would be to use two sockets or
-	 * threads. */
-	uint32_t t;
-	do {
-		 if(recv(c->sock, &t, sizeof(t), MSG_PEEK) != sizeof(t))
-			goto out_client;
-	} while(t != MMU_PROTO_REMAP_REQ);
-	struct mmu_proto_remap_req req;
-	if(recv(c->sock, &req, sizeof(req), 0) != sizeof(req))
+	 * pager.  The acknowledgement (REMAP_REQ) is received by
+	 * `mmu_client_thread`, which never enters the pager, and
+	 * handed to us through `c->acks`. */
+	if(mmu_client_call(c, ack, &rep, sizeof(rep)) == -1)
 		goto out_client;
-	assert(req.type == MMU_PROTO_REMAP_REQ);
 	return;
 
 	out_client:
-	mmu_client_destroy(c);
+	mmu_client_log(c, __func__, "client gone");
+}/*}}}*/
+
+void mmu_resident_range(pid_t pid, void *vaddr, const int *frames,/*{{{*/
+		const int *prots, int npages)
+{
+	int id = get_pid_id(pid);
+	assert(npages >= 1 && npages <= MMU_PROTO_RANGE_PAGES);
+	char list[MMU_PROTO_RANGE_PAGES * 7 + 1];
+	int len = 0;
+	for(int i = 0; i < npages; ++i) {
+		if(frames[i] == -1)
+			len += snprintf(list + len, sizeof(list) - len, " -");
+		else
+			len += snprintf(list + len, sizeof(list) - len, " %d:%d",
+					frames[i], prots[i]);
+	}
+	printf("%s pid %d vaddr %p frames%s\n", __func__, id, vaddr, list);
+	logd(LOG_DEBUG, "%s pid %d vaddr %p npages %d\n", __func__,
+			id, vaddr, npages);
+	struct mmu_client *c = mmu_client_search(pid);
+	int ack = mmu_client_ack_begin(c);
+	if(ack == -1)
+		goto out_client;
+	struct mmu_proto_remap_range_rep rep;
+	rep.type = MMU_PROTO_REMAP_RANGE_REP;
+	rep.id = (uint32_t)ack;
+	rep.npages = (uint32_t)npages;
+	rep.vaddr = (intptr_t)vaddr;
+	for(int i = 0; i < MMU_PROTO_RANGE_PAGES; ++i) {
+		void *page = (char *)vaddr + i * PAGESIZE;
+		if(i >= npages || frames[i] == -1) {
+			rep.offsets[i] = MMU_PROTO_NO_OFFSET;
+			rep.prots[i] = PROT_NONE;
+			continue;
+		}
+		mmu_client_set_prot(c, page, prots[i]);
+		rep.offsets[i] = (uint64_t)(PAGESIZE * frames[i]);
+		rep.prots[i] = (int32_t)prots[i];
+	}
+
+	/* Acknowledged like REMAP_REQ, see `mmu_resident` */
+	if(mmu_client_call(c, ack, &rep, sizeof(rep)) == -1)
+		goto out_client;
+	return;
+
+	out_client:
+	mmu_client_log(c, __func__, "client gone");
 }/*}}}*/
 
 
@@ -477,26 +1504,21 @@ void mmu_nonresident(pid_t pid, void *vaddr)/*{{{*/
 	printf("%s pid %d vaddr %p\n", __func__, id, vaddr);
 	logd(LOG_DEBUG, "%s pid %d vaddr %p\n", __func__, id, vaddr);
 	struct mmu_client *c = mmu_client_search(pid);
+	int ack = mmu_client_ack_begin(c);
+	if(ack == -1)
+		goto out_client;
+	mmu_client_set_prot(c, vaddr, PROT_NONE);
 	struct mmu_proto_chprot_rep rep;
 	rep.type = MMU_PROTO_CHPROT_REP;
+	rep.id = (uint32_t)ack;
 	rep.prot = PROT_NONE;
 	rep.vaddr = (intptr_t)vaddr;
-	if(send(c->sock, &rep, sizeof(rep), 0) != sizeof(rep))
-		goto out_client;
-
-	uint32_t t;
-	do {
-		if(recv(c->sock, &t, sizeof(t), MSG_PEEK) != sizeof(t))
-			goto out_client;
-	} while(t != MMU_PROTO_CHPROT_REQ);
-	struct mmu_proto_chprot_req req;
-	if(recv(c->sock, &req, sizeof(req), 0) != sizeof(req))
+	if(mmu_client_call(c, ack, &rep, sizeof(rep)) == -1)
 		goto out_client;
-	assert(req.type == MMU_PROTO_CHPROT_REQ);
 	return;
 
 	out_client:
-	mmu_client_destroy(c);
+	mmu_client_log(c, __func__, "client gone");
 }/*}}}*/
 
 void mmu_chprot(pid_t pid, void *vaddr, int prot)/*{{{*/
@@ -506,26 +1528,21 @@ void mmu_chprot(pid_t pid, void *vaddr, int prot)/*{{{*/
 	logd(LOG_DEBUG, "%s pid %d vaddr %p prot %d\n", __func__,
 			id, vaddr,prot);
 	struct mmu_client *c = mmu_client_search(pid);
+	int ack = mmu_client_ack_begin(c);
+	if(ack == -1)
+		goto out_client;
+	mmu_client_set_prot(c, vaddr, prot);
 	struct mmu_proto_chprot_rep rep;
 	rep.type = MMU_PROTO_CHPROT_REP;
+	rep.id = (uint32_t)ack;
 	rep.prot = (int32_t)prot;
 	rep.vaddr = (intptr_t)vaddr;
-	if(send(c->sock, &rep, sizeof(rep), 0) != sizeof(rep))
-		goto out_client;
-
-	uint32_t t;
-	do {
-		if(recv(c->sock, &t, sizeof(t), MSG_PEEK) != sizeof(t))
-			goto out_client;
-	} while(t != MMU_PROTO_CHPROT_REQ);
-	struct mmu_proto_chprot_req req;
-	if(recv(c->sock, &req, sizeof(req), 0) != sizeof(req))
+	if(mmu_client_call(c, ack, &rep, sizeof(rep)) == -1)
 		goto out_client;
-	assert(req.type == MMU_PROTO_CHPROT_REQ);
 	return;
 
 	out_client:
-	mmu_client_destroy(c);
+	mmu_client_log(c, __func__, "client gone");
 }/*}}}*/
 
 void mmu_disk_read(int block_from, int frame_to)/*{{{*/
@@ -534,8 +1551,10 @@ void mmu_disk_read(int block_from, int frame_to)/*{{{*/
 			block_from, frame_to);
 	logd(LOG_DEBUG, "%s from block %d to frame %d\n", __func__,
 			block_from, frame_to);
+	uint64_t start = hist_now();
 	memcpy(mmu->pmem + frame_to*PAGESIZE, mmu->disk + block_from*PAGESIZE,
 			PAGESIZE);
+	mmu_copy_done(start);
 }/*}}}*/
 
 void mmu_disk_write(int frame_from, int block_to)/*{{{*/
@@ -544,8 +1563,122 @@ void mmu_disk_write(int frame_from, int block_to)/*{{{*/
 			frame_from, block_to);
 	logd(LOG_DEBUG, "%s from frame %d to block %d\n", __func__,
 			frame_from, block_to);
+	uint64_t start = hist_now();
 	memcpy(mmu->disk + block_to*PAGESIZE, mmu->pmem + frame_from*PAGESIZE,
 			PAGESIZE);
+	mmu_copy_done(start);
+}/*}}}*/
+
+void mmu_copy_frame(int frame_from, int frame_to)/*{{{*/
+{
+	printf("%s from frame %d to frame %d\n", __func__,
+			frame_from, frame_to);
+	logd(LOG_DEBUG, "%s from frame %d to frame %d\n", __func__,
+			frame_from, frame_to);
+	uint64_t start = hist_now();
+	memcpy(mmu->pmem + frame_to*PAGESIZE, mmu->pmem + frame_from*PAGESIZE,
+			PAGESIZE);
+	mmu_copy_done(start);
+}/*}}}*/
+
+void mmu_copy_block(int block_from, int block_to)/*{{{*/
+{
+	printf("%s from block %d to block %d\n", __func__,
+			block_from, block_to);
+	logd(LOG_DEBUG, "%s from block %d to block %d\n", __func__,
+			block_from, block_to);
+	uint64_t start = hist_now();
+	memcpy(mmu->disk + block_to*PAGESIZE, mmu->disk + block_from*PAGESIZE,
+			PAGESIZE);
+	mmu_copy_done(start);
+}/*}}}*/
+
+void mmu_frame_fill(const void *data, int frame_to)/*{{{*/
+{
+	printf("%s to frame %d\n", __func__, frame_to);
+	logd(LOG_DEBUG, "%s to frame %d\n", __func__, frame_to);
+	uint64_t start = hist_now();
+	memcpy(mmu->pmem + frame_to*PAGESIZE, data, PAGESIZE);
+	mmu_copy_done(start);
+}/*}}}*/
+
+void mmu_block_fill(const void *data, int block_to)/*{{{*/
+{
+	printf("%s to block %d\n", __func__, block_to);
+	logd(LOG_DEBUG, "%s to block %d\n", __func__, block_to);
+	uint64_t start = hist_now();
+	memcpy(mmu->disk + block_to*PAGESIZE, data, PAGESIZE);
+	mmu_copy_done(start);
+}/*}}}*/
+
+void mmu_file_read(int fd, off_t offset, int frame_to)/*{{{*/
+{
+	printf("%s from offset %lld to frame %d\n", __func__,
+			(long long)offset, frame_to);
+	logd(LOG_DEBUG, "%s from fd %d offset %lld to frame %d\n", __func__,
+			fd, (long long)offset, frame_to);
+	uint64_t start = hist_now();
+	char *frame = mmu->pmem + frame_to*PAGESIZE;
+	ssize_t r = pread(fd, frame, PAGESIZE, offset);
+	if(r == -1) {
+		loge(LOG_ERROR, __FILE__, __LINE__);
+		r = 0;
+	}
+	memset(frame + r, 0, PAGESIZE - r);
+	mmu_copy_done(start);
+}/*}}}*/
+
+void mmu_file_write(int frame_from, int fd, off_t offset)/*{{{*/
+{
+	printf("%s from frame %d to offset %lld\n", __func__,
+			frame_from, (long long)offset);
+	logd(LOG_DEBUG, "%s from frame %d to fd %d offset %lld\n", __func__,
+			frame_from, fd, (long long)offset);
+	uint64_t start = hist_now();
+	struct stat st;
+	if(fstat(fd, &st) == -1) {
+		loge(LOG_ERROR, __FILE__, __LINE__);
+		return;
+	}
+	if(st.st_size <= offset) return;
+	size_t len = (size_t)(st.st_size - offset);
+	if(len > PAGESIZE) len = PAGESIZE;
+	if(pwrite(fd, mmu->pmem + frame_from*PAGESIZE, len, offset) == -1)
+		loge(LOG_ERROR, __FILE__, __LINE__);
+	mmu_copy_done(start);
+}/*}}}*/
+
+void mmu_copy_done(uint64_t start)/*{{{*/
+{
+	if(mmu_faulting) hist_record_since(latency.copy, start);
+}/*}}}*/
+
+int mmu_frame_save(int frame_from, int fd, off_t offset)/*{{{*/
+{
+	printf("%s from frame %d to offset %lld\n", __func__,
+			frame_from, (long long)offset);
+	logd(LOG_DEBUG, "%s from frame %d to fd %d offset %lld\n", __func__,
+			frame_from, fd, (long long)offset);
+	return mmu_save_page(mmu->pmem + frame_from*PAGESIZE, fd, offset);
+}/*}}}*/
+
+int mmu_block_save(int block_from, int fd, off_t offset)/*{{{*/
+{
+	printf("%s from block %d to offset %lld\n", __func__,
+			block_from, (long long)offset);
+	logd(LOG_DEBUG, "%s from block %d to fd %d offset %lld\n", __func__,
+			block_from, fd, (long long)offset);
+	return mmu_save_page(mmu->disk + block_from*PAGESIZE, fd, offset);
+}/*}}}*/
+
+int mmu_save_page(const char *page, int fd, off_t offset)/*{{{*/
+{
+	ssize_t n = pwrite(fd, page, PAGESIZE, offset);
+	if(n == PAGESIZE) return 0;
+	/* a short write means the file system filled up */
+	if(n != -1) errno = ENOSPC;
+	loge(LOG_ERROR, __FILE__, __LINE__);
+	return -1;
 }/*}}}*/
 /*}}}*/
 
@@ -556,7 +1689,10 @@ void mmu_disk_write(int frame_from, int block_to)/*{{{*/
 void pager_free(void);
 #endif
 void usage(int argc, char **argv) {/*{{{*/
-	printf("usage: %s NFRAMES NBLOCKS\n", argv[0]);
+	printf("usage: %s NFRAMES NBLOCKS [SWAPFILE]\n", argv[0]);
+	printf("\n");
+	printf("with SWAPFILE, disk blocks are kept in that file (and the\n");
+	printf("pager's metadata next to it) across restarts\n");
 	printf("\n");
 	printf("valid ranges: 2 <= NFRAMES <= 256\n");
 	printf("              4 <= NBLOCKS <= 1024\n");
@@ -564,18 +1700,21 @@ void usage(int argc, char **argv) {/*{{{*/
 }/*}}}*/
 
 int main(int argc, char **argv) {/*{{{*/
-	if(argc != 3) usage(argc, argv);
+	if(argc != 3 && argc != 4) usage(argc, argv);
 	int npages = atoi(argv[1]);
-	if(npages < 1 || npages > 256) usage(argc, argv);
+	if(npages < 1 || npages > MMU_MAX_FRAMES) usage(argc, argv);
 	int nblocks = atoi(argv[2]);
-	if(nblocks < 2 || nblocks > 1024) usage(argc, argv);
+	if(nblocks < 2 || nblocks > MMU_MAX_BLOCKS) usage(argc, argv);
+	if(argc == 4) swapfile = argv[3];
 	#ifdef MMULOG
 	log_init(LOG_EXTRA, "mmu.log", 1, 1<<20);
 	#endif
-	memset(id2pid, 255, UINT8_MAX * sizeof(pid_t));
+	memset(id2pid, 255, (UINT8_MAX + 1) * sizeof(pid_t));
 	mmu_init(npages, nblocks);
 	pager_init(npages, nblocks);
 	mmu_accept_loop();
+	mmu_stats_dump();
+	hist_log_all(LOG_INFO);
 	#ifdef MMUFREE
 	pager_free();
 	#endif
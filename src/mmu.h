@@ -5,6 +5,8 @@
 #ifndef __MMU_HEADER__
 #define __MMU_HEADER__
 
+#include <stdint.h>
+
 /* `UVM_BASEADDR` is where virtual pages will be mapped in process
  * virtual address spaces.  This address is not normally used by the
  * Linux kernel.  The page size for the architecture can be obtained
@@ -23,6 +25,12 @@
  * pager should never write to `pmem`.  */
 extern const char *pmem;
 
+/* `swapfile` is the path of the file holding the disk blocks when the
+ * MMU is started with one, or NULL if the disk lives in memory and is
+ * lost when the MMU exits.  Writes to a swap file survive an MMU
+ * restart; your pager can keep its own metadata next to it.  */
+extern const char *swapfile;
+
 /* All functions in this module are blocking, i.e., they only return after
  * changes to physical memory, disk, and program virtual addresses are
  * complete.  */
@@ -39,6 +47,16 @@ void mmu_zero_fill(int frame);
  * | PROT_WRITE`; these constants are defined in <sys/mman.h>.  */
 void mmu_resident(pid_t pid, void *vaddr, int frame, int prot);
 
+/* `mmu_resident_range` maps the `npages` consecutive pages starting at
+ * `vaddr` in process `pid`, page `i` to frame `frames[i]` with
+ * protection level `prots[i]`; pages whose frame is -1 are left alone.
+ * The whole range is changed in a single round trip to the process,
+ * so your pager should prefer it to several calls to `mmu_resident`.
+ * `npages` is at most `MMU_MAX_RANGE_PAGES`.  */
+#define MMU_MAX_RANGE_PAGES 64
+void mmu_resident_range(pid_t pid, void *vaddr, const int *frames,
+		const int *prots, int npages);
+
 /* `mmu_nonresident` will mark the page starting at `vaddr` as
  * inacessible by process `pid`.  See `mmu_resident` above for the
  * semantics on `vaddr` and `prot`.  */
@@ -49,6 +67,21 @@ void mmu_nonresident(pid_t pid, void *vaddr);
  * on `vaddr` and `prot`.  */
 void mmu_chprot(pid_t pid, void *vaddr, int prot);
 
+/* `mmu_page_flags` returns the flags of the pages of process `pid`,
+ * one byte per page, or NULL if the process has none (e.g., it is
+ * not connected).  The flags are shared with the process, so your
+ * pager should only change them with atomic operations.  Once your
+ * pager revokes access to a page with `mmu_chprot`, it may store
+ * `MMU_PAGE_SOFT` and the page's former protection in its flags: the
+ * next access restores that protection without a fault reaching your
+ * pager, and sets `MMU_PAGE_REFERENCED`.  Only the first access after
+ * the flags are stored is handled so.  The functions above clear the
+ * flags of the pages they change.  */
+#define MMU_PAGE_PROT 0x03 /* PROT_READ | PROT_WRITE */
+#define MMU_PAGE_SOFT 0x04
+#define MMU_PAGE_REFERENCED 0x08
+uint8_t * mmu_page_flags(pid_t pid);
+
 /* `mmu_disk_read` copies content from disk block `block_from` into
  * physical frame `frame_to`.  `mmu_disk_write` copies content from
  * frame `frame_from` to disk block `block_to`.  Your pager shoudl
@@ -56,4 +89,38 @@ void mmu_chprot(pid_t pid, void *vaddr, int prot);
 void mmu_disk_read(int block_from, int frame_to);
 void mmu_disk_write(int frame_from, int block_to);
 
+/* `mmu_copy_frame` copies the content of frame `frame_from` into
+ * frame `frame_to`.  Your pager should use this function to give
+ * a process its own copy of a frame shared with other processes. */
+void mmu_copy_frame(int frame_from, int frame_to);
+
+/* `mmu_copy_block` copies the content of disk block `block_from`
+ * into disk block `block_to`.  Your pager should use this function
+ * to move blocks out of a disk being shrunk (see `pager_resize`). */
+void mmu_copy_block(int block_from, int block_to);
+
+/* `mmu_frame_fill` copies a page of bytes at `data` into frame
+ * `frame_to`, and `mmu_block_fill` copies them into disk block
+ * `block_to`.  Your pager may use these functions to page out to
+ * memory of its own (e.g., compressed) instead of the disk.  */
+void mmu_frame_fill(const void *data, int frame_to);
+void mmu_block_fill(const void *data, int block_to);
+
+/* `mmu_file_read` copies the page at `offset` in the file open as
+ * `fd` into frame `frame_to`; bytes past the end of the file read as
+ * zeroes.  `mmu_file_write` copies frame `frame_from` back to the
+ * page at `offset` in `fd`, without growing the file.  Your pager
+ * should use these functions to page file-backed memory. */
+void mmu_file_read(int fd, off_t offset, int frame_to);
+void mmu_file_write(int frame_from, int fd, off_t offset);
+
+/* `mmu_frame_save` copies frame `frame_from` to the page at `offset`
+ * in the file open as `fd`, and `mmu_block_save` copies disk block
+ * `block_from`; both grow the file as needed.  They return 0 once the
+ * whole page is written; otherwise they return -1 and set errno
+ * (ENOSPC for a short write).  Your pager should use these functions
+ * to write snapshots of process memory. */
+int mmu_frame_save(int frame_from, int fd, off_t offset);
+int mmu_block_save(int block_from, int fd, off_t offset);
+
 #endif
@@ -14,16 +14,70 @@
  * receive the path to the memory-mapped file representing physical
  * memory.
  *
+ * The `FORK` message is sent by a client about to fork; the MMU
+ * clones the client's memory and replies with a random token
+ * identifying the clone, or with an `errno` value in `error`.  The
+ * forked child then registers with a `CLONE` message carrying the
+ * token instead of `CREATE`, and takes over the cloned memory; the
+ * MMU checks through the socket's credentials that it is a child of
+ * the forking client.
+ *
+ * The `SHARE` and `ATTACH` messages create and map named shared
+ * memory segments, and the `MMAP` message maps a file.  Their
+ * replies carry an `errno` value in `error` when `vaddr` is zero.
+ *
+ * The `CHECKPOINT` message saves the client's memory to a snapshot
+ * file, and the `RESTORE` message, sent right after `CREATE`, gives
+ * a new client the memory saved in a snapshot.  Their replies carry
+ * an `errno` value in `error`, zero on success.
+ *
+ * The `PERSIST` message binds the client's memory to a key so that
+ * it outlives the client (and, with a swap file, the MMU); a client
+ * sending a key whose memory is unattached takes it over, and the
+ * reply marks the pages it got in `pages`.  An empty key unbinds the
+ * memory.  The reply carries an `errno` value in `error`.
+ *
+ * The `LIMIT` message sets the client's resident and swap limits.
+ * The reply carries an `errno` value in `error`.
+ *
+ * The `STATS` message queries the paging counters of the client and
+ * of the whole system; the reply carries both.
+ *
+ * The `RESIZE` message changes the number of physical memory frames
+ * and disk blocks of the whole system while clients run; zero keeps
+ * the current number.  The reply carries an `errno` value in `error`.
+ *
  * The `EXTEND` and `SEGV` messages are generated by the client when
  * they allocate memory and experience a segmentation fault,
- * respectively.  The request functions (`uvm_extend` and
- * `uvm_segv_action`) wait on a condition variable for the request
- * to be serviced.
+ * respectively.  A single `EXTEND` message may allocate several
+ * consecutive pages.  The `RELEASE` message is generated when the client
+ * returns pages to the MMU.  The request functions (`uvm_extend`,
+ * `uvm_release`, and `uvm_segv_action`) wait on a condition variable
+ * for the request to be serviced.  `SEGV` tells whether the faulting
+ * access was a write, where the client can decode it, so the pager
+ * can map a page written first read-write at once.
+ *
+ * The `CREATE` and `CLONE` replies also carry, in `flags_fn`, the
+ * path of the client's page flags (see `mmu_page_flags`), which the
+ * client maps shared.  A page the pager revoked only to learn whether
+ * it is still used is marked there, and the client restores its
+ * protection itself when it faults, setting its referenced flag
+ * instead of sending `SEGV`.
  *
  * The `REMAP` and `CHPROT` messages are generated by the MMU and
  * are processed by `uvm_thread` asynchronously.  These messages are
  * used to service sergmentation faults and whenever the pager pages
- * some of the processes pages to disk. */
+ * some of the processes pages to disk.  A `REMAP_RANGE` message
+ * remaps several consecutive pages at once; `offsets` and `prots` hold
+ * one entry per page, and pages whose offset is `MMU_PROTO_NO_OFFSET`
+ * are left alone.
+ *
+ * All messages but `CREATE` and `EXIT` carry an `id`.  Clients may
+ * have several requests in flight (one per thread); the MMU echoes
+ * the request `id` in its reply so the client can wake the thread
+ * waiting on it.  Likewise, the client echoes the `id` of `REMAP`
+ * and `CHPROT` messages in its acknowledgement, which lets the MMU
+ * service requests from different client threads in parallel. */
 
 #ifndef __MMUPROTO_HEADER__
 #define __MMUPROTO_HEADER__
@@ -31,6 +85,17 @@
 /* From UNIX_PATH_MAX, see man (7) unix: */
 #define MMU_PROTO_PATH_MAX 108
 #define MMU_PROTO_UNIX_PATH "mmu.sock"
+/* Shared segment names, including the terminating null byte: */
+#define MMU_PROTO_NAME_MAX 64
+/* Absolute paths of mapped files, including the terminating null byte: */
+#define MMU_PROTO_FILE_MAX 256
+/* Most pages a client can have, (UVM_MAXADDR - UVM_BASEADDR + 1) / 4KiB */
+#define MMU_PROTO_MAX_PAGES 256
+/* Points of the miss-ratio curve in stats replies, see PAGER_MRC_POINTS */
+#define MMU_PROTO_MRC_POINTS 16
+/* Pages in a `REMAP_RANGE` message, see MMU_MAX_RANGE_PAGES */
+#define MMU_PROTO_RANGE_PAGES 64
+#define MMU_PROTO_NO_OFFSET UINT64_MAX
 
 #define MMU_PROTO_CREATE_REQ 1
 #define MMU_PROTO_CREATE_REP 2
@@ -44,8 +109,34 @@
 #define MMU_PROTO_REMAP_REP 10
 #define MMU_PROTO_CHPROT_REQ 11
 #define MMU_PROTO_CHPROT_REP 12
+#define MMU_PROTO_RELEASE_REQ 13
+#define MMU_PROTO_RELEASE_REP 14
+#define MMU_PROTO_FORK_REQ 15
+#define MMU_PROTO_FORK_REP 16
+#define MMU_PROTO_CLONE_REQ 17
+#define MMU_PROTO_CLONE_REP 18
+#define MMU_PROTO_SHARE_REQ 19
+#define MMU_PROTO_SHARE_REP 20
+#define MMU_PROTO_ATTACH_REQ 21
+#define MMU_PROTO_ATTACH_REP 22
+#define MMU_PROTO_MMAP_REQ 23
+#define MMU_PROTO_MMAP_REP 24
+#define MMU_PROTO_CHECKPOINT_REQ 25
+#define MMU_PROTO_CHECKPOINT_REP 26
+#define MMU_PROTO_RESTORE_REQ 27
+#define MMU_PROTO_RESTORE_REP 28
+#define MMU_PROTO_PERSIST_REQ 29
+#define MMU_PROTO_PERSIST_REP 30
 #define MMU_PROTO_EXIT_REQ 32
 #define MMU_PROTO_EXIT_REP 33
+#define MMU_PROTO_LIMIT_REQ 34
+#define MMU_PROTO_LIMIT_REP 35
+#define MMU_PROTO_STATS_REQ 36
+#define MMU_PROTO_STATS_REP 37
+#define MMU_PROTO_RESIZE_REQ 38
+#define MMU_PROTO_RESIZE_REP 39
+#define MMU_PROTO_REMAP_RANGE_REQ 40
+#define MMU_PROTO_REMAP_RANGE_REP 41
 
 struct mmu_proto_create_req {
 	uint32_t type;
@@ -54,55 +145,242 @@ struct mmu_proto_create_req {
 struct mmu_proto_create_rep {
 	uint32_t type;
 	char pmem_fn[MMU_PROTO_PATH_MAX];
+	char flags_fn[MMU_PROTO_PATH_MAX];
 } __attribute__((packed));
 
 struct mmu_proto_extend_req {
 	uint32_t type;
+	uint32_t id;
+	uint32_t npages;
 } __attribute__((packed));
 struct mmu_proto_extend_rep {
 	uint32_t type;
+	uint32_t id;
 	uint64_t vaddr;
 } __attribute__((packed));
 
 struct mmu_proto_syslog_req {
 	uint32_t type;
+	uint32_t id;
 	uint32_t len;
 	uint64_t addr;
 } __attribute__((packed));
 struct mmu_proto_syslog_rep {
 	uint32_t type;
+	uint32_t id;
 	uint32_t retcode;
 } __attribute__((packed));
 
 struct mmu_proto_segv_req {
 	uint32_t type;
+	uint32_t id;
 	int32_t code;
+	int32_t write; /* 1 for writes, 0 for reads, -1 if unknown */
 	uint64_t addr;
 } __attribute__((packed));
 struct mmu_proto_segv_rep {
 	uint32_t type;
+	uint32_t id;
 } __attribute__((packed));
 // segv causes remap and chprot to happen
 
 struct mmu_proto_remap_req {
 	uint32_t type;
+	uint32_t id;
 } __attribute__((packed));
 struct mmu_proto_remap_rep {
 	uint32_t type;
+	uint32_t id;
 	int32_t prot;
 	uint64_t offset;
 	uint64_t vaddr;
 } __attribute__((packed));
 
+struct mmu_proto_remap_range_req {
+	uint32_t type;
+	uint32_t id;
+} __attribute__((packed));
+struct mmu_proto_remap_range_rep {
+	uint32_t type;
+	uint32_t id;
+	uint32_t npages;
+	uint64_t vaddr;
+	uint64_t offsets[MMU_PROTO_RANGE_PAGES];
+	int32_t prots[MMU_PROTO_RANGE_PAGES];
+} __attribute__((packed));
+
 struct mmu_proto_chprot_req {
 	uint32_t type;
+	uint32_t id;
 } __attribute__((packed));
 struct mmu_proto_chprot_rep {
 	uint32_t type;
+	uint32_t id;
 	int32_t prot;
 	uint64_t vaddr;
 } __attribute__((packed));
 
+struct mmu_proto_release_req {
+	uint32_t type;
+	uint32_t id;
+	uint32_t npages;
+	uint64_t addr;
+} __attribute__((packed));
+struct mmu_proto_release_rep {
+	uint32_t type;
+	uint32_t id;
+	uint32_t retcode;
+} __attribute__((packed));
+
+struct mmu_proto_fork_req {
+	uint32_t type;
+	uint32_t id;
+} __attribute__((packed));
+struct mmu_proto_fork_rep {
+	uint32_t type;
+	uint32_t id;
+	uint32_t error;
+	uint64_t token;
+} __attribute__((packed));
+
+struct mmu_proto_clone_req {
+	uint32_t type;
+	uint32_t pid;
+	uint64_t token;
+} __attribute__((packed));
+struct mmu_proto_clone_rep {
+	uint32_t type;
+	uint32_t retcode;
+	char pmem_fn[MMU_PROTO_PATH_MAX];
+	char flags_fn[MMU_PROTO_PATH_MAX];
+} __attribute__((packed));
+
+struct mmu_proto_share_req {
+	uint32_t type;
+	uint32_t id;
+	uint32_t npages;
+	char name[MMU_PROTO_NAME_MAX];
+} __attribute__((packed));
+struct mmu_proto_share_rep {
+	uint32_t type;
+	uint32_t id;
+	int32_t error;
+	uint64_t vaddr;
+} __attribute__((packed));
+
+struct mmu_proto_attach_req {
+	uint32_t type;
+	uint32_t id;
+	char name[MMU_PROTO_NAME_MAX];
+} __attribute__((packed));
+struct mmu_proto_attach_rep {
+	uint32_t type;
+	uint32_t id;
+	int32_t error;
+	uint32_t npages;
+	uint64_t vaddr;
+} __attribute__((packed));
+
+struct mmu_proto_mmap_req {
+	uint32_t type;
+	uint32_t id;
+	uint32_t npages;
+	uint64_t offset;
+	char path[MMU_PROTO_FILE_MAX];
+} __attribute__((packed));
+struct mmu_proto_mmap_rep {
+	uint32_t type;
+	uint32_t id;
+	int32_t error;
+	uint64_t vaddr;
+} __attribute__((packed));
+
+struct mmu_proto_checkpoint_req {
+	uint32_t type;
+	uint32_t id;
+	char path[MMU_PROTO_FILE_MAX];
+} __attribute__((packed));
+struct mmu_proto_checkpoint_rep {
+	uint32_t type;
+	uint32_t id;
+	int32_t error;
+} __attribute__((packed));
+
+struct mmu_proto_restore_req {
+	uint32_t type;
+	uint32_t id;
+	char path[MMU_PROTO_FILE_MAX];
+} __attribute__((packed));
+struct mmu_proto_restore_rep {
+	uint32_t type;
+	uint32_t id;
+	int32_t error;
+} __attribute__((packed));
+
+struct mmu_proto_persist_req {
+	uint32_t type;
+	uint32_t id;
+	char key[MMU_PROTO_NAME_MAX];
+} __attribute__((packed));
+struct mmu_proto_persist_rep {
+	uint32_t type;
+	uint32_t id;
+	int32_t error;
+	uint8_t pages[MMU_PROTO_MAX_PAGES / 8]; /* bitmap of pages attached */
+} __attribute__((packed));
+
+struct mmu_proto_limit_req {
+	uint32_t type;
+	uint32_t id;
+	int32_t min_frames;
+	int32_t max_frames;
+	int32_t max_blocks;
+	int32_t local;
+} __attribute__((packed));
+struct mmu_proto_limit_rep {
+	uint32_t type;
+	uint32_t id;
+	int32_t error;
+} __attribute__((packed));
+
+struct mmu_proto_stats {
+	uint64_t minor_faults;
+	uint64_t major_faults;
+	uint64_t zero_fills;
+	uint64_t swap_ins;
+	uint64_t evictions;
+	uint64_t writebacks;
+	uint64_t second_chances;
+	uint64_t suspensions;
+	uint64_t resident;
+	uint64_t swap;
+	uint64_t mrc_refs;
+	uint64_t mrc_misses[MMU_PROTO_MRC_POINTS];
+} __attribute__((packed));
+struct mmu_proto_stats_req {
+	uint32_t type;
+	uint32_t id;
+} __attribute__((packed));
+struct mmu_proto_stats_rep {
+	uint32_t type;
+	uint32_t id;
+	int32_t error;
+	struct mmu_proto_stats proc;
+	struct mmu_proto_stats total;
+} __attribute__((packed));
+
+struct mmu_proto_resize_req {
+	uint32_t type;
+	uint32_t id;
+	int32_t nframes;
+	int32_t nblocks;
+} __attribute__((packed));
+struct mmu_proto_resize_rep {
+	uint32_t type;
+	uint32_t id;
+	int32_t error;
+} __attribute__((packed));
+
 struct mmu_proto_exit_req {
 	uint32_t type;
 } __attribute__((packed));
@@ -0,0 +1,173 @@
+#include <sys/mman.h>
+#include <sys/types.h>
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mmu.h"
+#include "mmustub.h"
+#include "pager.h"
+
+/*****************************************************************************
+ * static variables and function declarations
+ ****************************************************************************/
+#define MMUSTUB_MAX_PAGES 256
+#define MMUSTUB_MAX_FAULTS 8 /* for a single access */
+
+const char *pmem = NULL;
+const char *swapfile = NULL;
+static char *disk = NULL;
+static size_t PAGESIZE = 0;
+static uint8_t prots[MMUSTUB_MAX_PIDS][MMUSTUB_MAX_PAGES];
+static uint8_t flags[MMUSTUB_MAX_PIDS][MMUSTUB_MAX_PAGES];
+
+static void mmustub_set_prot(pid_t pid, const void *vaddr, int prot);
+static int mmustub_vaddr_to_page(const void *vaddr);
+
+/*****************************************************************************
+ * public functions
+ ****************************************************************************/
+void mmustub_init(int nframes, int nblocks)
+{
+	PAGESIZE = sysconf(_SC_PAGESIZE);
+	pmem = malloc(nframes * PAGESIZE);
+	disk = malloc(nblocks * PAGESIZE);
+	if(!pmem || !disk) {
+		perror("mmustub_init");
+		exit(EXIT_FAILURE);
+	}
+	memset(prots, PROT_NONE, sizeof(prots));
+	memset(flags, 0, sizeof(flags));
+}
+
+void mmustub_create(pid_t pid)
+{
+	assert(pid >= 1 && pid <= MMUSTUB_MAX_PIDS);
+	memset(prots[pid - 1], PROT_NONE, sizeof(prots[0]));
+	memset(flags[pid - 1], 0, sizeof(flags[0]));
+}
+
+int mmustub_access(pid_t pid, void *vaddr, int prot)
+{
+	assert(pid >= 1 && pid <= MMUSTUB_MAX_PIDS);
+	int page = mmustub_vaddr_to_page(vaddr);
+	uint8_t *cur = &prots[pid - 1][page];
+	uint8_t *soft = &flags[pid - 1][page];
+	int nfaults = 0;
+	while((*cur & prot) != prot) {
+		/* as the client does in uvm_segv_action */
+		if((*soft & MMU_PAGE_SOFT) && !(*soft & MMU_PAGE_REFERENCED)
+				&& (*soft & prot & PROT_WRITE) == (prot & PROT_WRITE)) {
+			*soft |= MMU_PAGE_REFERENCED;
+			*cur = *soft & MMU_PAGE_PROT;
+			if(*cur & PROT_WRITE) *cur |= PROT_READ;
+			continue;
+		}
+		if(nfaults == MMUSTUB_MAX_FAULTS) return -1;
+		pager_fault_access(pid, vaddr, (prot & PROT_WRITE) != 0);
+		nfaults++;
+	}
+	return nfaults;
+}
+
+/*****************************************************************************
+ * mmu functions (see mmu.h)
+ ****************************************************************************/
+void mmu_zero_fill(int frame)
+{
+	memset((char *)pmem + PAGESIZE*frame, '0', PAGESIZE);
+}
+
+void mmu_resident(pid_t pid, void *vaddr, int frame, int prot)
+{
+	mmustub_set_prot(pid, vaddr, prot);
+}
+
+void mmu_resident_range(pid_t pid, void *vaddr, const int *frames,
+		const int *prots, int npages)
+{
+	for(int i = 0; i < npages; ++i) {
+		if(frames[i] != -1)
+			mmustub_set_prot(pid, (char *)vaddr + i * PAGESIZE, prots[i]);
+	}
+}
+
+void mmu_nonresident(pid_t pid, void *vaddr)
+{
+	mmustub_set_prot(pid, vaddr, PROT_NONE);
+}
+
+void mmu_chprot(pid_t pid, void *vaddr, int prot)
+{
+	mmustub_set_prot(pid, vaddr, prot);
+}
+
+uint8_t * mmu_page_flags(pid_t pid)
+{
+	assert(pid >= 1 && pid <= MMUSTUB_MAX_PIDS);
+	return flags[pid - 1];
+}
+
+void mmu_disk_read(int block_from, int frame_to)
+{
+	memcpy((char *)pmem + frame_to*PAGESIZE, disk + block_from*PAGESIZE,
+			PAGESIZE);
+}
+
+void mmu_disk_write(int frame_from, int block_to)
+{
+	memcpy(disk + block_to*PAGESIZE, pmem + frame_from*PAGESIZE,
+			PAGESIZE);
+}
+
+void mmu_copy_frame(int frame_from, int frame_to)
+{
+	memcpy((char *)pmem + frame_to*PAGESIZE, pmem + frame_from*PAGESIZE,
+			PAGESIZE);
+}
+
+void mmu_copy_block(int block_from, int block_to)
+{
+	memcpy(disk + block_to*PAGESIZE, disk + block_from*PAGESIZE, PAGESIZE);
+}
+
+void mmu_frame_fill(const void *data, int frame_to)
+{
+	memcpy((char *)pmem + frame_to*PAGESIZE, data, PAGESIZE);
+}
+
+void mmu_block_fill(const void *data, int block_to)
+{
+	memcpy(disk + block_to*PAGESIZE, data, PAGESIZE);
+}
+
+void mmu_file_read(int fd, off_t offset, int frame_to)
+{
+	memset((char *)pmem + frame_to*PAGESIZE, 0, PAGESIZE);
+}
+
+void mmu_file_write(int frame_from, int fd, off_t offset) {}
+int mmu_frame_save(int frame_from, int fd, off_t offset) { return 0; }
+int mmu_block_save(int block_from, int fd, off_t offset) { return 0; }
+
+/*****************************************************************************
+ * static functions
+ ****************************************************************************/
+static void mmustub_set_prot(pid_t pid, const void *vaddr, int prot)
+{
+	assert(pid >= 1 && pid <= MMUSTUB_MAX_PIDS);
+	/* As on the hardware, writable pages are readable (pages given a
+	 * second chance get PROT_WRITE alone when written) */
+	if(prot & PROT_WRITE) prot |= PROT_READ;
+	prots[pid - 1][mmustub_vaddr_to_page(vaddr)] = (uint8_t)prot;
+	flags[pid - 1][mmustub_vaddr_to_page(vaddr)] = 0;
+}
+
+static int mmustub_vaddr_to_page(const void *vaddr)
+{
+	return (int)(((intptr_t)vaddr - UVM_BASEADDR) / (intptr_t)PAGESIZE);
+}
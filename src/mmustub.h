@@ -0,0 +1,37 @@
+/* This module implements the MMU functions called by the pager (see mmu.h)
+ * without sockets or client processes, so that programs can drive the pager
+ * directly (the trace simulator and the benchmark).  Physical memory and disk
+ * are plain buffers, and the protection the pager gives each page is kept in
+ * a table instead of being sent to a client.  The interface is as follows:
+ *
+ * (1) allocate memory and disk with =mmustub_init= before =pager_init=
+ * (2) reset the pages of each process with =mmustub_create= as it is given
+ *     to =pager_create=
+ * (3) touch pages with =mmustub_access=, which calls =pager_fault= like the
+ *     hardware would, or restores the page itself like a client would for
+ *     pages marked in its flags (see =mmu_page_flags=).
+ *
+ * Processes are numbered from 1 to =MMUSTUB_MAX_PIDS=.  Mapped files and
+ * snapshots are not supported. */
+
+#ifndef __MMUSTUB_HEADER__
+#define __MMUSTUB_HEADER__
+
+#include <sys/types.h>
+
+#define MMUSTUB_MAX_PIDS 256
+
+/* This function allocates =nframes= frames of physical memory and =nblocks=
+ * disk blocks. */
+void mmustub_init(int nframes, int nblocks);
+
+/* This function makes every page of process =pid= inaccessible. */
+void mmustub_create(pid_t pid);
+
+/* This function accesses =vaddr= in process =pid= with protection =prot=
+ * (PROT_READ, or PROT_READ | PROT_WRITE), faulting into the pager until the
+ * page allows it.  Returns the number of faults taken into the pager, or -1
+ * if the pager did not grant the access. */
+int mmustub_access(pid_t pid, void *vaddr, int prot);
+
+#endif
@@ -5,8 +5,36 @@
 #ifndef __PAGER_CREATE__
 #define __PAGER_CREATE__
 
+#include <stdint.h>
 #include <sys/types.h>
 
+/* Points of the miss-ratio curve in `struct pager_stats`: point `i`
+ * is for a memory of `(i + 1) * nframes / 8` frames, so the curve
+ * goes up to twice the frames the pager has. */
+#define PAGER_MRC_POINTS 16
+
+/* Paging counters of a process or of the whole system, see
+ * `pager_stats`.  Counters of events only grow; `resident` and `swap`
+ * give the current usage. */
+struct pager_stats {
+	uint64_t minor_faults; /* faults on resident pages */
+	uint64_t major_faults; /* faults (and syslogs) bringing pages into memory */
+	uint64_t zero_fills; /* pages brought in never written to swap */
+	uint64_t swap_ins; /* pages brought in from swap */
+	uint64_t evictions; /* pages (system-wide, frames) paged out */
+	uint64_t writebacks; /* dirty frames saved to swap or to files */
+	uint64_t second_chances; /* pages (system-wide, frames) spared by the clock */
+	uint64_t suspensions; /* times suspended by load control */
+	uint64_t resident; /* pages (system-wide, frames) in memory */
+	uint64_t swap; /* disk blocks reserved */
+	/* Approximate miss-ratio curve, estimated from faults sampled
+	 * when `PAGER_SHARDS_SAMPLES` is set (0s otherwise):
+	 * `mrc_misses[i]` of the `mrc_refs` references would fault with
+	 * point `i` frames (see PAGER_MRC_POINTS) under LRU. */
+	uint64_t mrc_refs;
+	uint64_t mrc_misses[PAGER_MRC_POINTS];
+};
+
 /* `pager_init` is called by the memory management infrastructure to
  * initialize the pager.  `nframes` and `nblocks` are the number of
  * physical memory frames available and the number of blocks for
@@ -23,9 +51,18 @@ void pager_create(pid_t pid);
  * in the infrastructure until the application actually accesses the
  * page (which will trigger a call to `pager_fault`).
  * `pager_extend` should return NULL is there are no disk blocks to
- * use as backing storage. */
+ * use as backing storage.  Pages freed with `pager_release` are
+ * reused (lowest-numbered first) before the heap grows. */
 void *pager_extend(pid_t pid);
 
+/* `pager_extend_range` allocates `npages` consecutive pages to
+ * process `pid` and returns a pointer to the first one.  Either all
+ * pages are allocated, each with its own disk block, or none is:
+ * `pager_extend_range` returns NULL if there are fewer than `npages`
+ * free disk blocks or no free range of `npages` pages in the
+ * process's address space. */
+void *pager_extend_range(pid_t pid, int npages);
+
 /* `pager_fault` is called when process `pid` receives
  * a segmentation fault at address `addr`.  `pager_fault` is only
  * called for addresses previously returned with `pager_extend`.  If
@@ -37,9 +74,21 @@ void *pager_extend(pid_t pid);
  * accesses the same (i.e., do not prioritize either).  As the
  * memory management infrastructure does not maintain page access
  * and writing information, your pager must track this information
- * to implement the second-chance algorithm. */
+ * to implement the second-chance algorithm.  Different threads of a
+ * process may fault concurrently; faults on different pages should
+ * not wait on each other's calls to the MMU functions. */
 void pager_fault(pid_t pid, void *addr);
 
+/* `pager_fault_access` is `pager_fault` for a fault whose access is
+ * known: `write` is 1 if the access was a write, 0 if it was a read,
+ * and -1 if it is unknown, as `pager_fault` passes.  A write to a
+ * non-resident page is serviced at once: the page is mapped
+ * read-write and marked dirty, instead of mapped read-only and
+ * faulted on again.  A read of a resident page only gets read access
+ * back, so frames and blocks shared copy-on-write stay shared; a
+ * fault of unknown access on a resident page is taken for a write. */
+void pager_fault_access(pid_t pid, void *addr, int write);
+
 /* `pager_syslog prints a message made of `len` bytes following
  * `addr` in the address space of process `pid`.  `pager_syslog`
  * should behave as if making read accesses to the process's memory
@@ -49,10 +98,164 @@ void pager_fault(pid_t pid, void *addr);
  * the syslog succeeds, it should return 0. */
 int pager_syslog(pid_t pid, void *addr, size_t len);
 
+/* `pager_release` frees the `npages` pages of process `pid` starting
+ * at the page-aligned address `addr`.  The frames and disk blocks
+ * backing these pages are freed immediately and dirty contents are
+ * discarded without being written to disk.  Resident pages are made
+ * inaccessible in the process with `mmu_nonresident`.  Released
+ * pages may be returned again by later calls to `pager_extend`.  If
+ * any page in the range was not allocated, `pager_release` frees
+ * nothing, returns -1 and sets errno to EINVAL; on success, it
+ * returns 0. */
+int pager_release(pid_t pid, void *addr, int npages);
+
+/* `pager_share` creates a shared memory segment called `name` made
+ * of `npages` pages, maps it into the address space of process
+ * `pid` like `pager_extend_range`, and returns a pointer to its first
+ * page.  Pages of a segment are backed by the same frames and disk
+ * blocks in every process that maps it: writes by one process are
+ * seen by all, and evicting a frame makes it nonresident in all of
+ * them.  The segment is freed when no process maps any of its pages.
+ * If a segment called `name` exists, `pager_share` returns NULL and
+ * sets errno to EEXIST; if there are fewer than `npages` free disk
+ * blocks or no free range in the address space, it returns NULL and
+ * sets errno to ENOSPC. */
+void *pager_share(pid_t pid, const char *name, int npages);
+
+/* `pager_attach` maps the segment called `name` into the address
+ * space of process `pid`, stores its size in `npages`, and returns
+ * a pointer to its first page.  If no segment is called `name`,
+ * returns NULL and sets errno to ENOENT; if the address space has no
+ * free range for the segment, returns NULL and sets errno to ENOSPC.
+ * Segment pages are detached with `pager_release`. */
+void *pager_attach(pid_t pid, const char *name, int *npages);
+
+/* `pager_mmap` maps `npages` pages of the file at `path`, starting
+ * at the page-aligned `offset`, into the address space of process
+ * `pid` and returns a pointer to the first page.  File pages use no
+ * disk blocks: they are read from the file on fault, clean pages are
+ * dropped on eviction, and dirty pages are written back to the file
+ * on eviction, release, and destroy.  Every process mapping a file
+ * shares its frames, as in `pager_share`.  On failure, returns NULL
+ * and sets errno to EINVAL if `offset` is not aligned, to ENOSPC if
+ * the address space has no free range, to EMFILE if too many files
+ * are mapped, or to the error returned by open(2). */
+void *pager_mmap(pid_t pid, const char *path, off_t offset, int npages);
+
+/* `pager_checkpoint` writes a snapshot of the memory of process
+ * `pid` to the file at `path` (see snapshot.h).  Resident pages are
+ * saved from their frames and swapped-out pages from disk, in page
+ * order, so the checkpoint makes no evictions.  Shared segments and
+ * mapped files are not saved.  The file at `path` is only replaced
+ * once the snapshot is complete.  Returns 0 on success; on failure,
+ * returns -1 and sets errno to the error raised writing the file. */
+int pager_checkpoint(pid_t pid, const char *path);
+
+/* `pager_restore` gives process `pid`, which must have no pages yet,
+ * the pages saved in the snapshot at `path`, at the same addresses.
+ * Each page gets a disk block, but is only read from the snapshot
+ * when it faults, so the cost of a restore depends on the pages the
+ * process touches.  Returns 0 on success; on failure, returns -1 and
+ * sets errno to EBUSY if the process has pages or is persistent (see
+ * `pager_persist`), to EINVAL if `path` is not a valid snapshot, to
+ * ENOSPC if there are not enough free disk blocks, or to the error
+ * raised opening the file. */
+int pager_restore(pid_t pid, const char *path);
+
+/* `pager_persist` binds the memory of process `pid`, which must have
+ * no pages yet, to `key`.  Persistent memory is not freed when the
+ * process is destroyed: a later process calling `pager_persist` with
+ * the same key gets its pages back, at the same addresses, and
+ * `valid[page]` is set to 1 for each of them (`valid` has an entry
+ * for every page between `UVM_BASEADDR` and `UVM_MAXADDR`).  Resident
+ * pages are written to disk when the process is destroyed, so the
+ * pages come back without being reloaded.  With a `swapfile`, the
+ * pager also journals which block backs each persistent page, and
+ * memory swapped out before the MMU exits survives a restart; pages
+ * only resident at that point come back with their last contents on
+ * disk.  Shared segments and mapped files are not persistent.
+ * Returns 0 on success; on failure, returns -1 and sets errno to
+ * EBUSY if the process has pages or a key, to EEXIST if another
+ * process holds `key`, or to ENAMETOOLONG if `key` is too long. */
+int pager_persist(pid_t pid, const char *key, char *valid);
+
+/* `pager_unpersist` unbinds the memory of process `pid` from its key:
+ * it becomes private to the process again and is freed when the
+ * process is destroyed.  Returns 0 on success; if the process has no
+ * key, returns -1 and sets errno to EINVAL. */
+int pager_unpersist(pid_t pid);
+
+/* `pager_limit` sets the limits of process `pid`; 0 indicates no
+ * limit.  While the process has at most `min_frames` resident pages,
+ * faults of other processes do not evict them.  A process with
+ * `max_frames` resident pages replaces one of its own on its next
+ * fault, even if free frames exist; with `local` set, it replaces its
+ * own pages whenever no frame is free.  Limits are ignored when the
+ * clock finds no frame they allow to evict.  `pager_extend` and
+ * `pager_restore` fail if the process would reserve more than
+ * `max_blocks` disk blocks.  Lowering a limit evicts or frees
+ * nothing.  Processes start with the limits given in the
+ * `PAGER_MIN_FRAMES`, `PAGER_MAX_FRAMES`, `PAGER_MAX_BLOCKS`, and
+ * `PAGER_LOCAL_REPLACEMENT` environment variables, and forked
+ * children inherit the limits of their parent.  Returns 0 on
+ * success; on failure, returns -1 and sets errno to EINVAL if a limit
+ * is negative or `min_frames` exceeds `max_frames`, or to ENOSPC if
+ * the minimums of all processes would leave no frame to evict. */
+int pager_limit(pid_t pid, int min_frames, int max_frames, int max_blocks, int local);
+
+/* `pager_stats` stores the paging counters of process `pid` in
+ * `stats` and the counters of the whole system, including processes
+ * already destroyed, in `total`.  Either may be NULL (pass -1 as
+ * `pid` when `stats` is NULL).  Returns 0 on success; if `stats` is
+ * given and no process is `pid`, returns -1 and sets errno to
+ * EINVAL. */
+int pager_stats(pid_t pid, struct pager_stats *stats, struct pager_stats *total);
+
+/* `pager_resize` is called when the memory management infrastructure
+ * changes the number of physical memory frames to `nframes` and the
+ * number of disk blocks to `nblocks`, while processes keep running.
+ * Frames and blocks are added at the end; the MMU grows memory and
+ * disk before calling `pager_resize`, and shrinks them after it
+ * returns.  When shrinking, the pager waits for pages being paged in
+ * or out of the removed range, then moves resident pages in removed
+ * frames to free frames, evicting them if none is free, and moves
+ * removed blocks in use to free blocks.  Returns 0 on success; on
+ * failure, returns -1 and sets errno to EINVAL if `nframes` or
+ * `nblocks` is less than 1, to ENOSPC if the minimums of all
+ * processes (see `pager_limit`) would take every frame or if the
+ * blocks reserved, the processes or the shared segments would not
+ * fit in `nblocks`, or to EBUSY if a clone pending since `pager_fork`
+ * lies in the removed range. */
+int pager_resize(int nframes, int nblocks);
+
+/* `pager_fork` is called before process `pid` forks.  It clones
+ * the page table of `pid` into a pending process that shares its
+ * frames and disk blocks, and write-protects the pages of `pid` so
+ * that the first write to a shared page by either process gets
+ * a private copy (copy on write).  The clone reserves one disk
+ * block per page for these copies.  `pager_fork` returns a random,
+ * nonzero token identifying the clone; if there are not enough free
+ * disk blocks or no room for another process, it returns 0 and sets
+ * errno to ENOSPC. */
+uint64_t pager_fork(pid_t pid);
+
+/* `pager_create_forked` is called instead of `pager_create` when
+ * the forked child `pid`, whose parent process is `parent`,
+ * registers, and hands it the clone identified by `token`.  The
+ * child inherited the parent's mappings when it forked, so no MMU
+ * function is called.  Returns 0 on success; if `token` does not
+ * identify a pending clone of `parent`, returns -1 and sets errno to
+ * EINVAL.  Clones never claimed are freed when their parent is
+ * destroyed, or once the child had five seconds to claim them, as
+ * their pages stay busy (and their frames pinned) until then. */
+int pager_create_forked(pid_t pid, pid_t parent, uint64_t token);
+
 /* `pager_destroy` is called when the process is already dead.  It
  * should free all resources process `pid` allocated (memory frames
  * and disk blocks).  `pager_destroy` should not call any of the MMU
- * functions. */
+ * functions on the process; it only writes back dirty frames of
+ * mapped files, of shared segments that other processes still map,
+ * and of persistent memory (see `pager_persist`), which it keeps. */
 void pager_destroy(pid_t pid);
 
 #endif
@@ -0,0 +1,453 @@
+/* The simulator replays fault traces recorded by the MMU (see trace.h)
+ * against the pager, with no sockets or client processes (see
+ * mmustub.h).  Each access in the trace faults into the pager until
+ * the page allows it, so traces can be replayed with any number of
+ * frames.
+ *
+ * Policies are sets of pager environment variables (e.g.,
+ * PAGER_LOCAL_REPLACEMENT=1); every policy is replayed with every
+ * frame count, each in a child process, and one line is printed for
+ * each run.  For reference, the trace can also be analyzed offline
+ * with Belady's optimal replacement (opt), which evicts the page used
+ * furthest in the future, and with exact LRU (lru), whose misses for
+ * every frame count come from the stack distances of the accesses.
+ * Both count misses only: the pager also faults to track references
+ * and writes, which these leave out. */
+
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "hist.h"
+
+#include "mmu.h"
+#include "mmustub.h"
+#include "pager.h"
+#include "trace.h"
+
+/****************************************************************************
+ * structure definitions and static variables
+ ***************************************************************************/
+#define SIM_MAX_PAGES 256
+#define SIM_MAX_POLICIES 16
+#define SIM_MAX_FRAMES 256
+#define SIM_NKEYS (MMUSTUB_MAX_PIDS * SIM_MAX_PAGES)
+#define SIM_NEVER LONG_MAX
+
+struct sim_policy {/*{{{*/
+	const char *name;
+	char *env; /* VAR=VALUE,VAR=VALUE, NULL for opt and lru */
+};/*}}}*/
+
+/* Access or process destruction, as seen by the offline analyses */
+struct sim_ref {/*{{{*/
+	uint16_t key; /* pid * SIM_MAX_PAGES + page */
+	uint8_t type; /* TRACE_READ, TRACE_WRITE or TRACE_DESTROY */
+};/*}}}*/
+
+struct sim_proc {/*{{{*/
+	int created;
+	int page[SIM_MAX_PAGES]; /* -1 indicates not extended */
+};/*}}}*/
+
+static size_t PAGESIZE = 0;
+static struct sim_proc procs[MMUSTUB_MAX_PIDS];
+static struct sim_ref *refs = NULL;
+static long nrefs = 0;
+static long naccesses = 0; /* refs that are not destructions */
+static long *lru_distances = NULL; /* accesses by stack distance */
+static long lru_cold = 0; /* first accesses */
+
+/****************************************************************************
+ * static function declarations
+ ***************************************************************************/
+static void sim_run(FILE *file, const struct trace_header *hdr,
+		const struct sim_policy *policy, int nframes);
+static void sim_replay(FILE *file, const struct trace_header *hdr,
+		const struct sim_policy *policy, int nframes);
+static int sim_vaddr_to_page(const void *vaddr);
+static void sim_load_refs(FILE *file);
+static void sim_opt(int nframes);
+static void sim_lru(int nframes);
+static void sim_lru_distances(void);
+static int sim_parse_frames(const char *arg, int *frames, int nframes);
+
+/****************************************************************************
+ * replay functions {{{
+ ***************************************************************************/
+void sim_run(FILE *file, const struct trace_header *hdr,/*{{{*/
+		const struct sim_policy *policy, int nframes)
+{
+	fflush(stdout);
+	pid_t child = fork();
+	if(child == -1) {
+		perror("fork");
+		exit(EXIT_FAILURE);
+	}
+	if(child == 0) {
+		sim_replay(file, hdr, policy, nframes);
+		exit(EXIT_SUCCESS);
+	}
+	int status;
+	waitpid(child, &status, 0);
+	if(!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+		printf("%s %d failed\n", policy->name, nframes);
+}/*}}}*/
+
+void sim_replay(FILE *file, const struct trace_header *hdr,/*{{{*/
+		const struct sim_policy *policy, int nframes)
+{
+	char *env = strdup(policy->env);
+	for(char *var = strtok(env, ","); var; var = strtok(NULL, ","))
+		putenv(var);
+
+	mmustub_init(nframes, (int)hdr->nblocks);
+	memset(procs, 0, sizeof(procs));
+
+	uint64_t start = hist_now();
+	pager_init(nframes, (int)hdr->nblocks);
+
+	struct trace_record rec;
+	unsigned long skipped = 0;
+	long accesses = 0;
+	while(fread(&rec, sizeof(rec), 1, file) == 1) {
+		struct sim_proc *proc = &procs[rec.pid];
+		pid_t pid = (pid_t)rec.pid + 1; /* -1 and 0 mean no process */
+		if(rec.type != TRACE_CREATE && !proc->created) {
+			skipped++;
+			continue;
+		}
+		switch(rec.type) {
+		case TRACE_CREATE:
+			mmustub_create(pid);
+			pager_create(pid);
+			proc->created = 1;
+			for(int i = 0; i < SIM_MAX_PAGES; ++i)
+				proc->page[i] = -1;
+			break;
+		case TRACE_EXTEND: {
+			void *vaddr = pager_extend(pid);
+			if(vaddr && rec.page < SIM_MAX_PAGES)
+				proc->page[rec.page] = sim_vaddr_to_page(vaddr);
+			else
+				skipped++;
+			break;
+		}
+		case TRACE_READ:
+		case TRACE_WRITE: {
+			if(rec.page >= SIM_MAX_PAGES || proc->page[rec.page] == -1) {
+				skipped++;
+				break;
+			}
+			void *vaddr = (void *)(UVM_BASEADDR
+					+ (intptr_t)proc->page[rec.page] * PAGESIZE);
+			int prot = rec.type == TRACE_WRITE
+					? PROT_READ | PROT_WRITE : PROT_READ;
+			if(mmustub_access(pid, vaddr, prot) == -1) {
+				fprintf(stderr, "pid %d page %d: access not granted\n",
+						rec.pid, (int)rec.page);
+				exit(EXIT_FAILURE);
+			}
+			accesses++;
+			break;
+		}
+		case TRACE_DESTROY:
+			pager_destroy(pid);
+			proc->created = 0;
+			break;
+		default:
+			fprintf(stderr, "invalid record type %d\n", rec.type);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	struct pager_stats total;
+	pager_stats(-1, NULL, &total);
+	uint64_t elapsed = hist_now() - start;
+	printf("%s %d %llu %llu %llu %llu %.3f %.4f",
+			policy->name, nframes,
+			(unsigned long long)(total.minor_faults + total.major_faults),
+			(unsigned long long)total.major_faults,
+			(unsigned long long)total.evictions,
+			(unsigned long long)total.writebacks,
+			elapsed / 1e6,
+			accesses ? (double)total.major_faults / accesses : 0.0);
+	if(skipped) printf(" (%lu records skipped)", skipped);
+	printf("\n");
+}/*}}}*/
+
+int sim_vaddr_to_page(const void *vaddr)/*{{{*/
+{
+	return (int)(((intptr_t)vaddr - UVM_BASEADDR) / (intptr_t)PAGESIZE);
+}/*}}}*/
+/*}}}*/
+
+/****************************************************************************
+ * offline analyses {{{
+ ***************************************************************************/
+void sim_load_refs(FILE *file)/*{{{*/
+{
+	/* Same records as `sim_replay` uses */
+	static char extended[SIM_NKEYS];
+	int created[MMUSTUB_MAX_PIDS];
+	memset(created, 0, sizeof(created));
+	long size = 0;
+	struct trace_record rec;
+	while(fread(&rec, sizeof(rec), 1, file) == 1) {
+		int key = rec.pid * SIM_MAX_PAGES + (rec.page % SIM_MAX_PAGES);
+		if(rec.type == TRACE_CREATE) {
+			created[rec.pid] = 1;
+			memset(extended + rec.pid * SIM_MAX_PAGES, 0, SIM_MAX_PAGES);
+			continue;
+		}
+		if(!created[rec.pid] || rec.page >= SIM_MAX_PAGES) continue;
+		if(rec.type == TRACE_EXTEND) {
+			extended[key] = 1;
+			continue;
+		}
+		if(rec.type == TRACE_DESTROY) {
+			created[rec.pid] = 0;
+			key = rec.pid * SIM_MAX_PAGES;
+		} else if(!extended[key]) {
+			continue;
+		} else {
+			naccesses++;
+		}
+		if(nrefs == size) {
+			size = size ? 2 * size : 4096;
+			refs = realloc(refs, size * sizeof(*refs));
+			if(!refs) {
+				perror("realloc");
+				exit(EXIT_FAILURE);
+			}
+		}
+		refs[nrefs].key = (uint16_t)key;
+		refs[nrefs].type = rec.type;
+		nrefs++;
+	}
+}/*}}}*/
+
+void sim_opt(int nframes)/*{{{*/
+{
+	uint64_t start = hist_now();
+
+	/* next[i] is when refs[i] is accessed again */
+	long *next = malloc(nrefs * sizeof(long));
+	long *last = malloc(SIM_NKEYS * sizeof(long));
+	int *where = malloc(SIM_NKEYS * sizeof(int)); /* frame, -1 if none */
+	if(!next || !last || !where) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+	for(int k = 0; k < SIM_NKEYS; ++k) last[k] = SIM_NEVER;
+	for(long i = nrefs - 1; i >= 0; --i) {
+		int key = refs[i].key;
+		if(refs[i].type == TRACE_DESTROY) {
+			for(int p = 0; p < SIM_MAX_PAGES; ++p)
+				last[key + p] = SIM_NEVER;
+			continue;
+		}
+		next[i] = last[key];
+		last[key] = i;
+	}
+
+	int keys[SIM_MAX_FRAMES];
+	long nexts[SIM_MAX_FRAMES];
+	char dirty[SIM_MAX_FRAMES];
+	for(int k = 0; k < SIM_NKEYS; ++k) where[k] = -1;
+	int nused = 0;
+	long misses = 0, evictions = 0, writebacks = 0;
+	for(long i = 0; i < nrefs; ++i) {
+		int key = refs[i].key;
+		if(refs[i].type == TRACE_DESTROY) {
+			int pid = key / SIM_MAX_PAGES;
+			for(int f = 0; f < nused; ++f) {
+				if(keys[f] / SIM_MAX_PAGES != pid) continue;
+				where[keys[f]] = -1;
+				nused--;
+				keys[f] = keys[nused];
+				nexts[f] = nexts[nused];
+				dirty[f] = dirty[nused];
+				if(f < nused) where[keys[f]] = f;
+				f--;
+			}
+			continue;
+		}
+		int f = where[key];
+		if(f == -1) {
+			misses++;
+			if(nused < nframes) {
+				f = nused++;
+			} else {
+				f = 0;
+				for(int g = 1; g < nused; ++g)
+					if(nexts[g] > nexts[f]) f = g;
+				evictions++;
+				if(dirty[f]) writebacks++;
+				where[keys[f]] = -1;
+			}
+			keys[f] = key;
+			dirty[f] = 0;
+			where[key] = f;
+		}
+		nexts[f] = next[i];
+		if(refs[i].type == TRACE_WRITE) dirty[f] = 1;
+	}
+	free(next);
+	free(last);
+	free(where);
+
+	printf("opt %d %ld %ld %ld %ld %.3f %.4f\n", nframes, misses, misses,
+			evictions, writebacks, (hist_now() - start) / 1e6,
+			naccesses ? (double)misses / naccesses : 0.0);
+}/*}}}*/
+
+void sim_lru(int nframes)/*{{{*/
+{
+	uint64_t start = hist_now();
+	if(!lru_distances) sim_lru_distances();
+	/* An access at stack distance d hits with d frames or more */
+	long misses = lru_cold;
+	for(long d = nframes + 1; d <= SIM_NKEYS; ++d)
+		misses += lru_distances[d];
+	printf("lru %d %ld %ld - - %.3f %.4f\n", nframes, misses, misses,
+			(hist_now() - start) / 1e6,
+			naccesses ? (double)misses / naccesses : 0.0);
+}/*}}}*/
+
+void sim_lru_distances(void)/*{{{*/
+{
+	/* Mattson's stack algorithm: pages ordered by last access, the
+	 * most recent first; destroyed processes leave the stack */
+	int *stack = malloc(SIM_NKEYS * sizeof(int));
+	lru_distances = calloc(SIM_NKEYS + 1, sizeof(long));
+	if(!stack || !lru_distances) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+	int depth = 0;
+	for(long i = 0; i < nrefs; ++i) {
+		int key = refs[i].key;
+		if(refs[i].type == TRACE_DESTROY) {
+			int pid = key / SIM_MAX_PAGES, kept = 0;
+			for(int d = 0; d < depth; ++d)
+				if(stack[d] / SIM_MAX_PAGES != pid)
+					stack[kept++] = stack[d];
+			depth = kept;
+			continue;
+		}
+		int d = 0;
+		while(d < depth && stack[d] != key) d++;
+		if(d == depth) {
+			lru_cold++;
+			depth++;
+		} else {
+			lru_distances[d + 1]++;
+		}
+		memmove(stack + 1, stack, d * sizeof(int));
+		stack[0] = key;
+	}
+	free(stack);
+}/*}}}*/
+
+int sim_parse_frames(const char *arg, int *frames, int nframes)/*{{{*/
+{
+	/* NFRAMES, or FIRST-LAST for every count in between */
+	int first, last;
+	char dash;
+	int n = sscanf(arg, "%d%c%d", &first, &dash, &last);
+	if(n == 1) last = first;
+	else if(n != 3 || dash != '-') return -1;
+	if(first < 2 || last > SIM_MAX_FRAMES || first > last) return -1;
+	for(int f = first; f <= last; ++f) {
+		if(nframes == SIM_MAX_FRAMES) return -1;
+		frames[nframes++] = f;
+	}
+	return nframes;
+}/*}}}*/
+/*}}}*/
+
+void usage(int argc, char **argv) {/*{{{*/
+	printf("usage: %s [-p NAME:VAR=VALUE,... | -p opt | -p lru]... TRACE\n",
+			argv[0]);
+	printf("       NFRAMES[-NFRAMES]...\n");
+	printf("\n");
+	printf("replays TRACE, recorded by the MMU with MMU_TRACE set, with\n");
+	printf("each NFRAMES and each policy (pager environment variables);\n");
+	printf("the default policy is called clock and sets nothing; opt and\n");
+	printf("lru analyze the trace with optimal and LRU replacement\n");
+	printf("\n");
+	printf("prints: policy nframes faults major-faults evictions\n");
+	printf("        writebacks runtime-ms miss-ratio\n");
+	exit(EXIT_FAILURE);
+}/*}}}*/
+
+int main(int argc, char **argv) {/*{{{*/
+	struct sim_policy policies[SIM_MAX_POLICIES];
+	int npolicies = 0;
+	int opt;
+	while((opt = getopt(argc, argv, "p:")) != -1) {
+		if(opt != 'p' || npolicies == SIM_MAX_POLICIES) usage(argc, argv);
+		char *sep = strchr(optarg, ':');
+		if(!sep && strcmp(optarg, "opt") && strcmp(optarg, "lru"))
+			usage(argc, argv);
+		if(sep) *sep = '\0';
+		policies[npolicies].name = optarg;
+		policies[npolicies].env = sep ? sep + 1 : NULL;
+		npolicies++;
+	}
+	if(npolicies == 0) {
+		policies[0].name = "clock";
+		policies[0].env = "";
+		npolicies = 1;
+	}
+	if(argc - optind < 2) usage(argc, argv);
+	int frames[SIM_MAX_FRAMES];
+	int nframes = 0;
+	for(int j = optind + 1; j < argc; ++j) {
+		nframes = sim_parse_frames(argv[j], frames, nframes);
+		if(nframes == -1) usage(argc, argv);
+	}
+
+	FILE *file = fopen(argv[optind], "r");
+	if(!file) {
+		perror(argv[optind]);
+		exit(EXIT_FAILURE);
+	}
+	struct trace_header hdr;
+	PAGESIZE = sysconf(_SC_PAGESIZE);
+	if(fread(&hdr, sizeof(hdr), 1, file) != 1
+			|| memcmp(hdr.magic, TRACE_MAGIC, TRACE_MAGIC_LEN)
+			|| hdr.pagesize != PAGESIZE) {
+		fprintf(stderr, "%s: not a trace\n", argv[optind]);
+		exit(EXIT_FAILURE);
+	}
+	long records = ftell(file);
+
+	for(int i = 0; i < npolicies; ++i) {
+		if(!policies[i].env && !refs) {
+			fseek(file, records, SEEK_SET);
+			sim_load_refs(file);
+		}
+		for(int j = 0; j < nframes; ++j) {
+			if(!policies[i].env && !strcmp(policies[i].name, "opt")) {
+				sim_opt(frames[j]);
+			} else if(!policies[i].env) {
+				sim_lru(frames[j]);
+			} else {
+				fseek(file, records, SEEK_SET);
+				sim_run(file, &hdr, &policies[i], frames[j]);
+			}
+			fflush(stdout);
+		}
+	}
+	fclose(file);
+	exit(EXIT_SUCCESS);
+}/*}}}*/
@@ -0,0 +1,34 @@
+/* Process memory snapshots are written by `pager_checkpoint` and
+ * read back by `pager_restore` (and by `uvm_restore` to learn which
+ * pages the restored process owns).
+ *
+ * A snapshot is a header followed by one entry for each page the
+ * process had allocated, in increasing page order.  Page contents
+ * follow the entries, starting at the first page-aligned offset, in
+ * the same order; pages that were never written have no contents
+ * and are zero-filled when restored. */
+
+#ifndef __SNAPSHOT_HEADER__
+#define __SNAPSHOT_HEADER__
+
+#include <stdint.h>
+
+#define SNAPSHOT_MAGIC "UVMSNAP1"
+#define SNAPSHOT_MAGIC_LEN 8
+
+/* Entry flags */
+#define SNAPSHOT_ZERO 1 /* page has no contents in the snapshot */
+
+struct snapshot_header {
+	char magic[SNAPSHOT_MAGIC_LEN];
+	uint32_t pagesize;
+	uint32_t nentries;
+} __attribute__((packed));
+
+struct snapshot_entry {
+	uint32_t page;
+	uint32_t flags;
+	uint64_t offset; /* of the page contents, unless SNAPSHOT_ZERO */
+} __attribute__((packed));
+
+#endif
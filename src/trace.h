@@ -0,0 +1,46 @@
+/* Fault traces are recorded by the MMU when the `MMU_TRACE`
+ * environment variable names a file, and replayed against the pager
+ * by the simulator (`bin/sim`, see sim.c).
+ *
+ * A trace is a header followed by one record for each process
+ * created, page allocated, access that faulted, and process
+ * destroyed, in the order the MMU handled them.  Accesses that did not
+ * fault are not seen by the MMU and are not in the trace.  A fault on
+ * a page the client could not access is recorded as a read (writes to
+ * such pages fault again once the page is readable); a fault on a
+ * read-only page is recorded as a write.  Processes are numbered as in
+ * the MMU output.  Forked processes, shared segments and mapped files
+ * are not recorded.  The MMU numbers processes modulo 256, so only the
+ * first 256 processes created are recorded; the MMU logs a warning
+ * when it leaves one out. */
+
+#ifndef __TRACE_HEADER__
+#define __TRACE_HEADER__
+
+#include <stdint.h>
+
+#define TRACE_MAGIC "UVMTRAC1"
+#define TRACE_MAGIC_LEN 8
+
+/* Record types */
+#define TRACE_CREATE 0
+#define TRACE_EXTEND 1
+#define TRACE_READ 2
+#define TRACE_WRITE 3
+#define TRACE_DESTROY 4
+
+struct trace_header {
+	char magic[TRACE_MAGIC_LEN];
+	uint32_t pagesize;
+	uint32_t nframes;
+	uint32_t nblocks;
+} __attribute__((packed));
+
+struct trace_record {
+	uint64_t time; /* nanoseconds since the MMU started */
+	uint8_t pid;
+	uint8_t type;
+	uint16_t page; /* from UVM_BASEADDR, 0 for CREATE and DESTROY */
+} __attribute__((packed));
+
+#endif
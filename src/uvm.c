@@ -2,6 +2,7 @@
  * DEPARTAMENTO DE CIENCIA DA COMPUTACAO    *
  * Copyright (c) Italo Fernando Scota Cunha */
 
+#define _GNU_SOURCE /* REG_ERR, see uvm_segv_action */
 #include "uvm.h"
 
 #include <sys/mman.h>
@@ -19,26 +20,43 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <ucontext.h>
 #include <unistd.h>
 
 #include "log.h"
 
 #include "mmu.h"
 #include "mmuproto.h"
+#include "snapshot.h"
 
 /****************************************************************************
  * structure definitions and static variables
  ***************************************************************************/
+#define UVM_MAX_REQUESTS 64
+
+/* Completion slot for a request in flight.  The slot index is sent
+ * to the MMU as the request `id` and echoed back in the reply. */
+struct uvm_request {/*{{{*/
+	int busy;
+	int done;
+	intptr_t result;
+	intptr_t aux; /* second result, e.g. an errno value */
+	void *buf; /* where replies carrying data store it */
+	pthread_cond_t cond;
+};/*}}}*/
+
 struct uvm_data {/*{{{*/
 	int running;
-	int npages;
+	size_t maxpages;
+	char *pages; /* 1 indicates page was allocated with uvm_extend */
 	int sock;
 	pthread_t thread;
 	pthread_mutex_t mutex;
-	pthread_cond_t cond;
+	pthread_cond_t cond; /* signaled when a request slot is freed */
 	char *pmem_fn;
 	int pmem_fd;
-	intptr_t result;
+	uint8_t *flags; /* page flags shared with the MMU, see mmu_page_flags */
+	struct uvm_request requests[UVM_MAX_REQUESTS];
 };/*}}}*/
 
 static struct uvm_data *uvm = NULL;
@@ -53,12 +71,38 @@ static void uvm_segv_action(int signum, siginfo_t *si, void *context);
 /* Protocol message handlers assume assume `uvm->mutex` is locked. */
 static void uvm_proto_extend_rep(void);
 static void uvm_proto_syslog_rep(void);
+static void uvm_proto_release_rep(void);
+static void uvm_proto_fork_rep(void);
+static void uvm_proto_share_rep(void);
+static void uvm_proto_attach_rep(void);
+static void uvm_proto_mmap_rep(void);
+static void uvm_proto_checkpoint_rep(void);
+static void uvm_proto_restore_rep(void);
+static void uvm_proto_persist_rep(void);
+static void uvm_proto_limit_rep(void);
+static void uvm_proto_stats_rep(void);
+static void uvm_proto_resize_rep(void);
+static void uvm_stats_copy(struct uvm_stats *u, const struct mmu_proto_stats *p);
 static void uvm_proto_segv_rep(void);
 static void uvm_proto_remap_rep(void);
+static void uvm_proto_remap_range_rep(void);
 static void uvm_proto_chprot_rep(void);
 
 /* Helper functions */
+static void uvm_connect(void);
+static void uvm_map_flags(const char *flags_fn);
+static char * uvm_abspath(const char *path);
+static int uvm_mark_snapshot_pages(const char *path);
+static int uvm_persist_request(const char *key);
 static void uvm_connect_socket(int sock, const struct sockaddr_un * addr);
+static void uvm_start_thread(void);
+
+/* Request slot functions also assume `uvm->mutex` is locked.
+ * `uvm_request_wait` releases the slot and returns the result. */
+static uint32_t uvm_request_begin(void);
+static intptr_t uvm_request_wait(uint32_t id);
+static void uvm_request_complete(uint32_t id, intptr_t result,
+		intptr_t aux);
 
 #define NUM_CONNECTION_TRIES 3
 
@@ -79,18 +123,11 @@ void uvm_create(void)/*{{{*/
 	uvm = malloc(sizeof(*uvm));
 	if(!uvm) prexit();
 	uvm->running = 1;
-	uvm->npages = 0;
-
-	logd(LOG_DEBUG, "  connecting unix socket [%s]\n", MMU_PROTO_UNIX_PATH);
-	uvm->sock = socket(AF_UNIX, SOCK_STREAM, 0);
-	if(uvm->sock == -1)
-		prexit();
-	struct sockaddr_un addr;
-	addr.sun_family = AF_UNIX;
-	addr.sun_path[0] = '\0';
-	strncat(addr.sun_path, MMU_PROTO_UNIX_PATH, MMU_PROTO_PATH_MAX-1);
+	uvm->maxpages = (UVM_MAXADDR - UVM_BASEADDR + 1) / sysconf(_SC_PAGESIZE);
+	uvm->pages = calloc(uvm->maxpages, sizeof(uvm->pages[0]));
+	if(!uvm->pages) prexit();
 
-	uvm_connect_socket(uvm->sock, &addr);
+	uvm_connect();
 
 	logd(LOG_DEBUG, "  sending CREATE_REQ [%d]\n", (int)getpid());
 	struct mmu_proto_create_req req;
@@ -109,6 +146,8 @@ void uvm_create(void)/*{{{*/
 	uvm->pmem_fd = open(uvm->pmem_fn, O_RDWR);
 	if(uvm->pmem_fd == -1)
 		prexit();
+	uvm->flags = NULL;
+	uvm_map_flags(rep.flags_fn);
 
 	logd(LOG_DEBUG, "  setting up SEGV handler\n");
 	struct sigaction new;
@@ -118,10 +157,7 @@ void uvm_create(void)/*{{{*/
 		prexit();
 	sigaction(SIGSEGV, &new, NULL);
 
-	logd(LOG_DEBUG, "  starting uvm_thread()\n");
-	pthread_mutex_init(&uvm->mutex, NULL);
-	pthread_cond_init(&uvm->cond, NULL);
-	pthread_create(&uvm->thread, NULL, uvm_thread, NULL);
+	uvm_start_thread();
 
 	logd(LOG_DEBUG, "  setting up uvm_exit() on_exit()\n");
 	if(on_exit(uvm_exit, NULL)) prexit();
@@ -130,15 +166,26 @@ void uvm_create(void)/*{{{*/
 }/*}}}*/
 
 void * uvm_extend(void) {/*{{{*/
+	return uvm_extend_n(1);
+}/*}}}*/
+
+void * uvm_extend_n(size_t npages) {/*{{{*/
 	pthread_mutex_lock(&uvm->mutex);
 	struct mmu_proto_extend_req req;
 	req.type = MMU_PROTO_EXTEND_REQ;
+	req.id = uvm_request_begin();
+	req.npages = npages;
 	if(send(uvm->sock, &req, sizeof(req), 0) != sizeof(req))
 		prexit();
-	pthread_cond_wait(&uvm->cond, &uvm->mutex);
-	if(uvm->result) uvm->npages++;
+	intptr_t result = uvm_request_wait(req.id);
+	if(result) {
+		size_t first = (result - UVM_BASEADDR) / sysconf(_SC_PAGESIZE);
+		memset(uvm->pages + first, 1, npages);
+	} else {
+		errno = ENOSPC;
+	}
 	pthread_mutex_unlock(&uvm->mutex);
-	return (void *)uvm->result;
+	return (void *)result;
 }/*}}}*/
 
 int uvm_syslog(void *addr, size_t len)/*{{{*/
@@ -146,19 +193,458 @@ int uvm_syslog(void *addr, size_t len)/*{{{*/
 	pthread_mutex_lock(&uvm->mutex);
 	struct mmu_proto_syslog_req req;
 	req.type = MMU_PROTO_SYSLOG_REQ;
+	req.id = uvm_request_begin();
 	req.addr = (intptr_t)addr;
 	req.len = len;
 	if(send(uvm->sock, &req, sizeof(req), 0) != sizeof(req))
 		prexit();
-	pthread_cond_wait(&uvm->cond, &uvm->mutex);
-	if(uvm->result != 0) errno = EINVAL;
+	intptr_t result = uvm_request_wait(req.id);
+	if(result != 0) errno = EINVAL;
+	pthread_mutex_unlock(&uvm->mutex);
+	return (int)result;
+}/*}}}*/
+
+int uvm_release(void *addr, size_t npages)/*{{{*/
+{
+	/* would be truncated in the request */
+	if(npages > uvm->maxpages) {
+		errno = EINVAL;
+		return -1;
+	}
+	pthread_mutex_lock(&uvm->mutex);
+	struct mmu_proto_release_req req;
+	req.type = MMU_PROTO_RELEASE_REQ;
+	req.id = uvm_request_begin();
+	req.addr = (intptr_t)addr;
+	req.npages = npages;
+	if(send(uvm->sock, &req, sizeof(req), 0) != sizeof(req))
+		prexit();
+	intptr_t result = uvm_request_wait(req.id);
+	if(result == 0) {
+		size_t pagesz = sysconf(_SC_PAGESIZE);
+		size_t first = ((intptr_t)addr - UVM_BASEADDR) / pagesz;
+		memset(uvm->pages + first, 0, npages);
+		/* the MMU already revoked access; drop the mappings too */
+		logd(LOG_DEBUG, "unmapping %p npages %zu\n", addr, npages);
+		if(munmap(addr, npages * pagesz) == -1)
+			prexit();
+	} else {
+		errno = EINVAL;
+	}
 	pthread_mutex_unlock(&uvm->mutex);
-	return (int)uvm->result;
+	return (int)result;
+}/*}}}*/
+
+void * uvm_share(const char *name, size_t npages)/*{{{*/
+{
+	if(strlen(name) >= MMU_PROTO_NAME_MAX) {
+		errno = ENAMETOOLONG;
+		return NULL;
+	}
+	pthread_mutex_lock(&uvm->mutex);
+	struct mmu_proto_share_req req;
+	req.type = MMU_PROTO_SHARE_REQ;
+	req.id = uvm_request_begin();
+	req.npages = npages;
+	memset(req.name, '\0', MMU_PROTO_NAME_MAX);
+	strncpy(req.name, name, MMU_PROTO_NAME_MAX - 1);
+	if(send(uvm->sock, &req, sizeof(req), 0) != sizeof(req))
+		prexit();
+	intptr_t result = uvm_request_wait(req.id);
+	if(result) {
+		size_t first = (result - UVM_BASEADDR) / sysconf(_SC_PAGESIZE);
+		memset(uvm->pages + first, 1, npages);
+	} else {
+		errno = (int)uvm->requests[req.id].aux;
+	}
+	pthread_mutex_unlock(&uvm->mutex);
+	return (void *)result;
+}/*}}}*/
+
+void * uvm_attach(const char *name, size_t *npages)/*{{{*/
+{
+	if(strlen(name) >= MMU_PROTO_NAME_MAX) {
+		errno = ENAMETOOLONG;
+		return NULL;
+	}
+	pthread_mutex_lock(&uvm->mutex);
+	struct mmu_proto_attach_req req;
+	req.type = MMU_PROTO_ATTACH_REQ;
+	req.id = uvm_request_begin();
+	memset(req.name, '\0', MMU_PROTO_NAME_MAX);
+	strncpy(req.name, name, MMU_PROTO_NAME_MAX - 1);
+	if(send(uvm->sock, &req, sizeof(req), 0) != sizeof(req))
+		prexit();
+	intptr_t result = uvm_request_wait(req.id);
+	intptr_t aux = uvm->requests[req.id].aux;
+	if(result) {
+		size_t first = (result - UVM_BASEADDR) / sysconf(_SC_PAGESIZE);
+		memset(uvm->pages + first, 1, (size_t)aux);
+		if(npages) *npages = (size_t)aux;
+	} else {
+		errno = (int)aux;
+	}
+	pthread_mutex_unlock(&uvm->mutex);
+	return (void *)result;
+}/*}}}*/
+
+void * uvm_mmap(const char *path, off_t offset, size_t len)/*{{{*/
+{
+	size_t pagesz = sysconf(_SC_PAGESIZE);
+	if(len == 0 || offset < 0 || offset % pagesz != 0) {
+		errno = EINVAL;
+		return NULL;
+	}
+	/* the MMU opens the file, so it needs a path independent of our
+	 * working directory */
+	char *abspath = realpath(path, NULL);
+	if(!abspath) return NULL;
+	if(strlen(abspath) >= MMU_PROTO_FILE_MAX) {
+		free(abspath);
+		errno = ENAMETOOLONG;
+		return NULL;
+	}
+	size_t npages = (len + pagesz - 1) / pagesz;
+
+	pthread_mutex_lock(&uvm->mutex);
+	struct mmu_proto_mmap_req req;
+	req.type = MMU_PROTO_MMAP_REQ;
+	req.id = uvm_request_begin();
+	req.npages = npages;
+	req.offset = (uint64_t)offset;
+	memset(req.path, '\0', MMU_PROTO_FILE_MAX);
+	strncpy(req.path, abspath, MMU_PROTO_FILE_MAX - 1);
+	free(abspath);
+	if(send(uvm->sock, &req, sizeof(req), 0) != sizeof(req))
+		prexit();
+	intptr_t result = uvm_request_wait(req.id);
+	if(result) {
+		size_t first = (result - UVM_BASEADDR) / pagesz;
+		memset(uvm->pages + first, 1, npages);
+	} else {
+		errno = (int)uvm->requests[req.id].aux;
+	}
+	pthread_mutex_unlock(&uvm->mutex);
+	return (void *)result;
+}/*}}}*/
+
+int uvm_checkpoint(const char *path)/*{{{*/
+{
+	char *abspath = uvm_abspath(path);
+	if(!abspath) return -1;
+	pthread_mutex_lock(&uvm->mutex);
+	struct mmu_proto_checkpoint_req req;
+	req.type = MMU_PROTO_CHECKPOINT_REQ;
+	req.id = uvm_request_begin();
+	memset(req.path, '\0', MMU_PROTO_FILE_MAX);
+	strncpy(req.path, abspath, MMU_PROTO_FILE_MAX - 1);
+	free(abspath);
+	if(send(uvm->sock, &req, sizeof(req), 0) != sizeof(req))
+		prexit();
+	intptr_t result = uvm_request_wait(req.id);
+	if(result != 0) errno = (int)uvm->requests[req.id].aux;
+	pthread_mutex_unlock(&uvm->mutex);
+	return (int)result;
+}/*}}}*/
+
+int uvm_restore(const char *path)/*{{{*/
+{
+	char *abspath = uvm_abspath(path);
+	if(!abspath) return -1;
+	pthread_mutex_lock(&uvm->mutex);
+	struct mmu_proto_restore_req req;
+	req.type = MMU_PROTO_RESTORE_REQ;
+	req.id = uvm_request_begin();
+	memset(req.path, '\0', MMU_PROTO_FILE_MAX);
+	strncpy(req.path, abspath, MMU_PROTO_FILE_MAX - 1);
+	if(send(uvm->sock, &req, sizeof(req), 0) != sizeof(req))
+		prexit();
+	intptr_t result = uvm_request_wait(req.id);
+	if(result != 0) {
+		errno = (int)uvm->requests[req.id].aux;
+	} else if(uvm_mark_snapshot_pages(abspath) == -1) {
+		/* the MMU validated the snapshot; it changed under us */
+		prexit();
+	}
+	pthread_mutex_unlock(&uvm->mutex);
+	free(abspath);
+	return (int)result;
+}/*}}}*/
+
+int uvm_persist(const char *key)/*{{{*/
+{
+	if(key[0] == '\0') {
+		errno = EINVAL;
+		return -1;
+	}
+	if(strlen(key) >= MMU_PROTO_NAME_MAX) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	return uvm_persist_request(key);
+}/*}}}*/
+
+int uvm_unpersist(void)/*{{{*/
+{
+	return uvm_persist_request("");
+}/*}}}*/
+
+int uvm_limit(int min_frames, int max_frames, int max_blocks, int local)/*{{{*/
+{
+	pthread_mutex_lock(&uvm->mutex);
+	struct mmu_proto_limit_req req;
+	req.type = MMU_PROTO_LIMIT_REQ;
+	req.id = uvm_request_begin();
+	req.min_frames = (int32_t)min_frames;
+	req.max_frames = (int32_t)max_frames;
+	req.max_blocks = (int32_t)max_blocks;
+	req.local = (int32_t)local;
+	if(send(uvm->sock, &req, sizeof(req), 0) != sizeof(req))
+		prexit();
+	intptr_t result = uvm_request_wait(req.id);
+	if(result != 0) errno = (int)uvm->requests[req.id].aux;
+	pthread_mutex_unlock(&uvm->mutex);
+	return (int)result;
+}/*}}}*/
+
+void uvm_stats_copy(struct uvm_stats *u, const struct mmu_proto_stats *p)/*{{{*/
+{
+	u->minor_faults = p->minor_faults;
+	u->major_faults = p->major_faults;
+	u->zero_fills = p->zero_fills;
+	u->swap_ins = p->swap_ins;
+	u->evictions = p->evictions;
+	u->writebacks = p->writebacks;
+	u->second_chances = p->second_chances;
+	u->suspensions = p->suspensions;
+	u->resident = p->resident;
+	u->swap = p->swap;
+	u->mrc_refs = p->mrc_refs;
+	for(int i = 0; i < UVM_MRC_POINTS; ++i)
+		u->mrc_misses[i] = p->mrc_misses[i];
+}/*}}}*/
+
+int uvm_stats(struct uvm_stats *stats, struct uvm_stats *total)/*{{{*/
+{
+	struct mmu_proto_stats buf[2];
+	pthread_mutex_lock(&uvm->mutex);
+	struct mmu_proto_stats_req req;
+	req.type = MMU_PROTO_STATS_REQ;
+	req.id = uvm_request_begin();
+	uvm->requests[req.id].buf = buf;
+	if(send(uvm->sock, &req, sizeof(req), 0) != sizeof(req))
+		prexit();
+	intptr_t result = uvm_request_wait(req.id);
+	if(result != 0) errno = (int)uvm->requests[req.id].aux;
+	pthread_mutex_unlock(&uvm->mutex);
+	if(result != 0) return -1;
+	if(stats != NULL) uvm_stats_copy(stats, &buf[0]);
+	if(total != NULL) uvm_stats_copy(total, &buf[1]);
+	return 0;
+}/*}}}*/
+
+int uvm_resize(int nframes, int nblocks)/*{{{*/
+{
+	pthread_mutex_lock(&uvm->mutex);
+	struct mmu_proto_resize_req req;
+	req.type = MMU_PROTO_RESIZE_REQ;
+	req.id = uvm_request_begin();
+	req.nframes = (int32_t)nframes;
+	req.nblocks = (int32_t)nblocks;
+	if(send(uvm->sock, &req, sizeof(req), 0) != sizeof(req))
+		prexit();
+	intptr_t result = uvm_request_wait(req.id);
+	if(result != 0) errno = (int)uvm->requests[req.id].aux;
+	pthread_mutex_unlock(&uvm->mutex);
+	return (int)result;
+}/*}}}*/
+
+pid_t uvm_fork(void)/*{{{*/
+{
+	pthread_mutex_lock(&uvm->mutex);
+	struct mmu_proto_fork_req req;
+	req.type = MMU_PROTO_FORK_REQ;
+	req.id = uvm_request_begin();
+	if(send(uvm->sock, &req, sizeof(req), 0) != sizeof(req))
+		prexit();
+	uint64_t token = (uint64_t)uvm_request_wait(req.id);
+	if(token == 0) {
+		errno = (int)uvm->requests[req.id].aux;
+		pthread_mutex_unlock(&uvm->mutex);
+		return -1;
+	}
+
+	/* the child signals on `ready` once it has claimed the clone; the
+	 * MMU frees unclaimed clones when the parent exits or when they
+	 * expire, so a failed fork leaves the clone to expire. */
+	int ready[2];
+	if(pipe(ready) == -1) {
+		int error = errno;
+		pthread_mutex_unlock(&uvm->mutex);
+		errno = error;
+		return -1;
+	}
+	pid_t pid = fork();
+	if(pid == -1) {
+		int error = errno;
+		close(ready[0]);
+		close(ready[1]);
+		pthread_mutex_unlock(&uvm->mutex);
+		errno = error;
+		return -1;
+	}
+
+	if(pid == 0) {
+		/* only this thread survives the fork: rebuild the client state
+		 * on a fresh connection, keeping the inherited pmem mapping. */
+		close(ready[0]);
+		close(uvm->sock);
+		uvm->running = 1;
+		uvm_connect();
+
+		logd(LOG_DEBUG, "  sending CLONE_REQ [%d]\n", (int)getpid());
+		struct mmu_proto_clone_req creq;
+		creq.type = MMU_PROTO_CLONE_REQ;
+		creq.pid = (uint32_t)getpid();
+		creq.token = token;
+		if(send(uvm->sock, &creq, sizeof(creq), 0) != sizeof(creq))
+			prexit();
+		struct mmu_proto_clone_rep crep;
+		if(recv(uvm->sock, &crep, sizeof(crep), 0) != sizeof(crep))
+			prexit();
+		assert(crep.type == MMU_PROTO_CLONE_REP);
+		if(crep.retcode != 0) {
+			errno = EINVAL;
+			prexit();
+		}
+		uvm_map_flags(crep.flags_fn);
+
+		uvm_start_thread();
+		char c = 0;
+		if(write(ready[1], &c, 1) != 1) prexit();
+		close(ready[1]);
+		return 0;
+	}
+
+	pthread_mutex_unlock(&uvm->mutex);
+	close(ready[1]);
+	char c;
+	ssize_t r;
+	do { r = read(ready[0], &c, 1); } while(r == -1 && errno == EINTR);
+	if(r != 1) logd(LOG_ERROR, "forked child %d died early\n", (int)pid);
+	close(ready[0]);
+	return pid;
 }/*}}}*/
 
 /****************************************************************************
  * auxiliary functions
  ***************************************************************************/
+void uvm_connect(void)/*{{{*/
+{
+	logd(LOG_DEBUG, "  connecting unix socket [%s]\n", MMU_PROTO_UNIX_PATH);
+	uvm->sock = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(uvm->sock == -1)
+		prexit();
+	struct sockaddr_un addr;
+	addr.sun_family = AF_UNIX;
+	addr.sun_path[0] = '\0';
+	strncat(addr.sun_path, MMU_PROTO_UNIX_PATH, MMU_PROTO_PATH_MAX-1);
+
+	uvm_connect_socket(uvm->sock, &addr);
+}/*}}}*/
+
+/* Maps the page flags at `flags_fn` in place of the current ones,
+ * which a forked child inherits from its parent. */
+void uvm_map_flags(const char *flags_fn)/*{{{*/
+{
+	char *fn = strndup(flags_fn, MMU_PROTO_PATH_MAX);
+	if(!fn) prexit();
+	logd(LOG_DEBUG, "  mapping flags_fn [%s]\n", fn);
+	int fd = open(fn, O_RDWR);
+	if(fd == -1) prexit();
+	int flags = MAP_SHARED | (uvm->flags ? MAP_FIXED : 0);
+	uvm->flags = mmap(uvm->flags, MMU_PROTO_MAX_PAGES,
+			PROT_READ | PROT_WRITE, flags, fd, 0);
+	if(uvm->flags == MAP_FAILED) prexit();
+	close(fd);
+	free(fn);
+}/*}}}*/
+
+/* The MMU opens files itself, so it needs paths independent of our
+ * working directory.  Unlike realpath, works for files not yet
+ * created. */
+char * uvm_abspath(const char *path)/*{{{*/
+{
+	char *abspath;
+	if(path[0] == '/') {
+		abspath = strdup(path);
+	} else {
+		char *cwd = getcwd(NULL, 0);
+		if(!cwd) return NULL;
+		abspath = malloc(strlen(cwd) + strlen(path) + 2);
+		if(abspath) sprintf(abspath, "%s/%s", cwd, path);
+		free(cwd);
+	}
+	if(!abspath) return NULL;
+	if(strlen(abspath) >= MMU_PROTO_FILE_MAX) {
+		free(abspath);
+		errno = ENAMETOOLONG;
+		return NULL;
+	}
+	return abspath;
+}/*}}}*/
+
+/* Marks the pages saved in snapshot `path` as allocated. */
+int uvm_mark_snapshot_pages(const char *path)/*{{{*/
+{
+	int fd = open(path, O_RDONLY);
+	if(fd == -1) return -1;
+	struct snapshot_header header;
+	struct snapshot_entry entry;
+	int ret = 0;
+	if(read(fd, &header, sizeof(header)) != sizeof(header)) ret = -1;
+	for(uint32_t i = 0; ret == 0 && i < header.nentries; ++i) {
+		if(read(fd, &entry, sizeof(entry)) != sizeof(entry)
+				|| entry.page >= uvm->maxpages) {
+			ret = -1;
+			break;
+		}
+		uvm->pages[entry.page] = 1;
+	}
+	close(fd);
+	return ret;
+}/*}}}*/
+
+/* Sends a PERSIST request; `uvm_proto_persist_rep` marks the pages
+ * the client gets. */
+int uvm_persist_request(const char *key)/*{{{*/
+{
+	pthread_mutex_lock(&uvm->mutex);
+	struct mmu_proto_persist_req req;
+	req.type = MMU_PROTO_PERSIST_REQ;
+	req.id = uvm_request_begin();
+	memset(req.key, '\0', MMU_PROTO_NAME_MAX);
+	strncpy(req.key, key, MMU_PROTO_NAME_MAX - 1);
+	if(send(uvm->sock, &req, sizeof(req), 0) != sizeof(req))
+		prexit();
+	intptr_t result = uvm_request_wait(req.id);
+	if(result != 0) errno = (int)uvm->requests[req.id].aux;
+	pthread_mutex_unlock(&uvm->mutex);
+	return (int)result;
+}/*}}}*/
+
+void uvm_start_thread(void)/*{{{*/
+{
+	logd(LOG_DEBUG, "  starting uvm_thread()\n");
+	pthread_mutex_init(&uvm->mutex, NULL);
+	pthread_cond_init(&uvm->cond, NULL);
+	for(int i = 0; i < UVM_MAX_REQUESTS; ++i) {
+		uvm->requests[i].busy = 0;
+		pthread_cond_init(&uvm->requests[i].cond, NULL);
+	}
+	pthread_create(&uvm->thread, NULL, uvm_thread, NULL);
+}/*}}}*/
+
 void * uvm_thread(void *data) {/*{{{*/
 	logd(LOG_DEBUG, "uvm_thread masking SEGV\n");
 	sigset_t sigset;
@@ -166,8 +652,8 @@ void * uvm_thread(void *data) {/*{{{*/
 	if(sigaddset(&sigset, SIGSEGV) == -1) prexit();
 	if(sigprocmask(SIG_BLOCK, &sigset, NULL) == -1) prexit();
 
+	logd(LOG_DEBUG, "uvm_thread waiting message\n");
 	while(uvm->running) {
-		logd(LOG_DEBUG, "uvm_thread waiting message\n");
 		uint32_t type;
 		ssize_t c = recv(uvm->sock, &type, sizeof(type), MSG_PEEK);
 		if(!uvm->running) break;
@@ -180,12 +666,48 @@ void * uvm_thread(void *data) {/*{{{*/
 			case MMU_PROTO_SYSLOG_REP:
 				uvm_proto_syslog_rep();
 				break;
+			case MMU_PROTO_RELEASE_REP:
+				uvm_proto_release_rep();
+				break;
+			case MMU_PROTO_FORK_REP:
+				uvm_proto_fork_rep();
+				break;
+			case MMU_PROTO_SHARE_REP:
+				uvm_proto_share_rep();
+				break;
+			case MMU_PROTO_ATTACH_REP:
+				uvm_proto_attach_rep();
+				break;
+			case MMU_PROTO_MMAP_REP:
+				uvm_proto_mmap_rep();
+				break;
+			case MMU_PROTO_CHECKPOINT_REP:
+				uvm_proto_checkpoint_rep();
+				break;
+			case MMU_PROTO_RESTORE_REP:
+				uvm_proto_restore_rep();
+				break;
+			case MMU_PROTO_PERSIST_REP:
+				uvm_proto_persist_rep();
+				break;
+			case MMU_PROTO_LIMIT_REP:
+				uvm_proto_limit_rep();
+				break;
+			case MMU_PROTO_STATS_REP:
+				uvm_proto_stats_rep();
+				break;
+			case MMU_PROTO_RESIZE_REP:
+				uvm_proto_resize_rep();
+				break;
 			case MMU_PROTO_SEGV_REP:
 				uvm_proto_segv_rep();
 				break;
 			case MMU_PROTO_REMAP_REP:
 				uvm_proto_remap_rep();
 				break;
+			case MMU_PROTO_REMAP_RANGE_REP:
+				uvm_proto_remap_range_rep();
+				break;
 			case MMU_PROTO_CHPROT_REP:
 				uvm_proto_chprot_rep();
 				break;
@@ -196,6 +718,9 @@ void * uvm_thread(void *data) {/*{{{*/
 				prexit();
 				break;
 		}
+		/* log while holding the mutex: `uvm_fork` must not fork while
+		 * this thread holds the log's lock. */
+		logd(LOG_DEBUG, "uvm_thread waiting message\n");
 		pthread_mutex_unlock(&uvm->mutex);
 	}
 	logd(LOG_DEBUG, "uvm_thread exiting\n");
@@ -215,8 +740,12 @@ void uvm_exit(int status, void *arg)/*{{{*/
 
 	pthread_mutex_destroy(&uvm->mutex);
 	pthread_cond_destroy(&uvm->cond);
+	for(int i = 0; i < UVM_MAX_REQUESTS; ++i)
+		pthread_cond_destroy(&uvm->requests[i].cond);
 	free(uvm->pmem_fn);
+	free(uvm->pages);
 	close(uvm->pmem_fd);
+	munmap(uvm->flags, MMU_PROTO_MAX_PAGES);
 	free(uvm);
 	uvm = NULL;
 	#ifdef UVMLOG
@@ -236,21 +765,53 @@ void uvm_segv_action(int signum, siginfo_t *si, void *context)/*{{{*/
 		exit(EXIT_FAILURE);
 	}
 	size_t pagesz = sysconf(_SC_PAGESIZE);
-	if(va >= UVM_BASEADDR + (uvm->npages * pagesz)) {
+	size_t page = (va - UVM_BASEADDR) / pagesz;
+	if(!uvm->pages[page]) {
 		logd(LOG_DEBUG, "access to unnallocated MMU address.\n");
 		fprintf(stderr, "(internal) segmentation fault.\n");
 		fprintf(stderr, "address %p not allocated.\n", (void *)va);
 		exit(EXIT_FAILURE);
 	}
 
+#if defined(__x86_64__) || defined(__i386__)
+	/* bit 1 of the page fault error code is set by writes */
+	ucontext_t *uc = context;
+	int write = (uc->uc_mcontext.gregs[REG_ERR] & 2) != 0;
+#else
+	int write = -1;
+#endif
+
+	/* Pages the pager revoked only to see whether they are still used
+	 * get their protection back here, once, without a round trip; the
+	 * MMU clears the flags before it changes the page, and the change
+	 * waits for `uvm->mutex`. */
+	uint8_t flags = __atomic_load_n(&uvm->flags[page], __ATOMIC_SEQ_CST);
+	while((flags & MMU_PAGE_SOFT) && !(flags & MMU_PAGE_REFERENCED)
+			&& (write != 1 || (flags & PROT_WRITE))) {
+		if(!__atomic_compare_exchange_n(&uvm->flags[page], &flags,
+				flags | MMU_PAGE_REFERENCED, 0, __ATOMIC_SEQ_CST,
+				__ATOMIC_SEQ_CST))
+			continue;
+		void *vaddr = (void *)(UVM_BASEADDR + page * pagesz);
+		if(mprotect(vaddr, pagesz, flags & MMU_PAGE_PROT) == -1)
+			prexit();
+		logd(LOG_DEBUG, "%s restored page %zu prot %d\n", __func__,
+				page, flags & MMU_PAGE_PROT);
+		pthread_mutex_unlock(&uvm->mutex);
+		return;
+	}
+
 	struct mmu_proto_segv_req req;
 	req.type = MMU_PROTO_SEGV_REQ;
+	req.id = uvm_request_begin();
 	req.addr = (intptr_t)si->si_addr;
 	req.code = si->si_code;
+	req.write = write;
 	if(send(uvm->sock, &req, sizeof(req), 0) != sizeof(req)) prexit();
 
-	logd(LOG_DEBUG, "%s waiting service at condition variable\n", __func__);
-	pthread_cond_wait(&uvm->cond, &uvm->mutex);
+	logd(LOG_DEBUG, "%s waiting service at request %u\n", __func__,
+			req.id);
+	uvm_request_wait(req.id);
 	pthread_mutex_unlock(&uvm->mutex);
 	logd(LOG_DEBUG, "%s returning\n", __func__);
 }/*}}}*/
@@ -265,8 +826,7 @@ void uvm_proto_extend_rep(void)/*{{{*/
 	if(recv(uvm->sock, &rep, sizeof(rep), 0) != sizeof(rep))
 		prexit();
 	assert(rep.type == MMU_PROTO_EXTEND_REP);
-	uvm->result = (intptr_t)rep.vaddr;
-	pthread_cond_signal(&uvm->cond);
+	uvm_request_complete(rep.id, (intptr_t)rep.vaddr, 0);
 }/*}}}*/
 
 void uvm_proto_syslog_rep(void)/*{{{*/
@@ -276,8 +836,125 @@ void uvm_proto_syslog_rep(void)/*{{{*/
 	if(recv(uvm->sock, &rep, sizeof(rep), 0) != sizeof(rep))
 		prexit();
 	assert(rep.type == MMU_PROTO_SYSLOG_REP);
-	uvm->result = (intptr_t)rep.retcode;
-	pthread_cond_signal(&uvm->cond);
+	uvm_request_complete(rep.id, (intptr_t)rep.retcode, 0);
+}/*}}}*/
+
+void uvm_proto_release_rep(void)/*{{{*/
+{
+	logd(LOG_DEBUG, "processing RELEASE_REP\n");
+	struct mmu_proto_release_rep rep;
+	if(recv(uvm->sock, &rep, sizeof(rep), 0) != sizeof(rep))
+		prexit();
+	assert(rep.type == MMU_PROTO_RELEASE_REP);
+	uvm_request_complete(rep.id, (intptr_t)(int32_t)rep.retcode, 0);
+}/*}}}*/
+
+void uvm_proto_fork_rep(void)/*{{{*/
+{
+	logd(LOG_DEBUG, "processing FORK_REP\n");
+	struct mmu_proto_fork_rep rep;
+	if(recv(uvm->sock, &rep, sizeof(rep), 0) != sizeof(rep))
+		prexit();
+	assert(rep.type == MMU_PROTO_FORK_REP);
+	uvm_request_complete(rep.id, (intptr_t)rep.token, (intptr_t)rep.error);
+}/*}}}*/
+
+void uvm_proto_share_rep(void)/*{{{*/
+{
+	logd(LOG_DEBUG, "processing SHARE_REP\n");
+	struct mmu_proto_share_rep rep;
+	if(recv(uvm->sock, &rep, sizeof(rep), 0) != sizeof(rep))
+		prexit();
+	assert(rep.type == MMU_PROTO_SHARE_REP);
+	uvm_request_complete(rep.id, (intptr_t)rep.vaddr, rep.error);
+}/*}}}*/
+
+void uvm_proto_attach_rep(void)/*{{{*/
+{
+	logd(LOG_DEBUG, "processing ATTACH_REP\n");
+	struct mmu_proto_attach_rep rep;
+	if(recv(uvm->sock, &rep, sizeof(rep), 0) != sizeof(rep))
+		prexit();
+	assert(rep.type == MMU_PROTO_ATTACH_REP);
+	uvm_request_complete(rep.id, (intptr_t)rep.vaddr,
+			rep.vaddr ? (intptr_t)rep.npages : rep.error);
+}/*}}}*/
+
+void uvm_proto_mmap_rep(void)/*{{{*/
+{
+	logd(LOG_DEBUG, "processing MMAP_REP\n");
+	struct mmu_proto_mmap_rep rep;
+	if(recv(uvm->sock, &rep, sizeof(rep), 0) != sizeof(rep))
+		prexit();
+	assert(rep.type == MMU_PROTO_MMAP_REP);
+	uvm_request_complete(rep.id, (intptr_t)rep.vaddr, rep.error);
+}/*}}}*/
+
+void uvm_proto_checkpoint_rep(void)/*{{{*/
+{
+	logd(LOG_DEBUG, "processing CHECKPOINT_REP\n");
+	struct mmu_proto_checkpoint_rep rep;
+	if(recv(uvm->sock, &rep, sizeof(rep), 0) != sizeof(rep))
+		prexit();
+	assert(rep.type == MMU_PROTO_CHECKPOINT_REP);
+	uvm_request_complete(rep.id, rep.error ? -1 : 0, rep.error);
+}/*}}}*/
+
+void uvm_proto_restore_rep(void)/*{{{*/
+{
+	logd(LOG_DEBUG, "processing RESTORE_REP\n");
+	struct mmu_proto_restore_rep rep;
+	if(recv(uvm->sock, &rep, sizeof(rep), 0) != sizeof(rep))
+		prexit();
+	assert(rep.type == MMU_PROTO_RESTORE_REP);
+	uvm_request_complete(rep.id, rep.error ? -1 : 0, rep.error);
+}/*}}}*/
+
+void uvm_proto_persist_rep(void)/*{{{*/
+{
+	logd(LOG_DEBUG, "processing PERSIST_REP\n");
+	struct mmu_proto_persist_rep rep;
+	if(recv(uvm->sock, &rep, sizeof(rep), 0) != sizeof(rep))
+		prexit();
+	assert(rep.type == MMU_PROTO_PERSIST_REP);
+	for(size_t i = 0; i < uvm->maxpages && i < MMU_PROTO_MAX_PAGES; ++i) {
+		if(rep.pages[i / 8] & (1 << (i % 8))) uvm->pages[i] = 1;
+	}
+	uvm_request_complete(rep.id, rep.error ? -1 : 0, rep.error);
+}/*}}}*/
+
+void uvm_proto_limit_rep(void)/*{{{*/
+{
+	logd(LOG_DEBUG, "processing LIMIT_REP\n");
+	struct mmu_proto_limit_rep rep;
+	if(recv(uvm->sock, &rep, sizeof(rep), 0) != sizeof(rep))
+		prexit();
+	assert(rep.type == MMU_PROTO_LIMIT_REP);
+	uvm_request_complete(rep.id, rep.error ? -1 : 0, rep.error);
+}/*}}}*/
+
+void uvm_proto_stats_rep(void)/*{{{*/
+{
+	logd(LOG_DEBUG, "processing STATS_REP\n");
+	struct mmu_proto_stats_rep rep;
+	if(recv(uvm->sock, &rep, sizeof(rep), 0) != sizeof(rep))
+		prexit();
+	assert(rep.type == MMU_PROTO_STATS_REP);
+	if(rep.id >= UVM_MAX_REQUESTS || !uvm->requests[rep.id].busy) prexit();
+	struct mmu_proto_stats *buf = uvm->requests[rep.id].buf;
+	buf[0] = rep.proc;
+	buf[1] = rep.total;
+	uvm_request_complete(rep.id, rep.error ? -1 : 0, rep.error);
+}/*}}}*/
+
+void uvm_proto_resize_rep(void)/*{{{*/
+{
+	logd(LOG_DEBUG, "processing RESIZE_REP\n");
+	struct mmu_proto_resize_rep rep;
+	if(recv(uvm->sock, &rep, sizeof(rep), 0) != sizeof(rep))
+		prexit();
+	assert(rep.type == MMU_PROTO_RESIZE_REP);
+	uvm_request_complete(rep.id, rep.error ? -1 : 0, rep.error);
 }/*}}}*/
 
 void uvm_proto_segv_rep(void)/*{{{*/
@@ -287,7 +964,7 @@ void uvm_proto_segv_rep(void)/*{{{*/
 	if(recv(uvm->sock, &rep, sizeof(rep), 0) != sizeof(rep))
 		prexit();
 	assert(rep.type == MMU_PROTO_SEGV_REP);
-	pthread_cond_signal(&uvm->cond);
+	uvm_request_complete(rep.id, 0, 0);
 }/*}}}*/
 
 void uvm_proto_remap_rep(void)/*{{{*/
@@ -316,6 +993,49 @@ void uvm_proto_remap_rep(void)/*{{{*/
 
 	struct mmu_proto_remap_req req;
 	req.type = MMU_PROTO_REMAP_REQ;
+	req.id = rep.id;
+	if(send(uvm->sock, &req, sizeof(req), 0) != sizeof(req)) prexit();
+}/*}}}*/
+
+void uvm_proto_remap_range_rep(void)/*{{{*/
+{
+	logd(LOG_DEBUG, "processing REMAP_RANGE_REP\n");
+	struct mmu_proto_remap_range_rep rep;
+	if(recv(uvm->sock, &rep, sizeof(rep), MSG_WAITALL) != sizeof(rep))
+		prexit();
+	assert(rep.type == MMU_PROTO_REMAP_RANGE_REP);
+	assert(rep.npages <= MMU_PROTO_RANGE_PAGES);
+
+	assert(rep.vaddr < UINTPTR_MAX);
+	size_t pagesz = sysconf(_SC_PAGESIZE);
+	/* Pages backed by consecutive frames with the same protection are
+	 * remapped with a single mmap, so such a run costs one system call */
+	for(uint32_t i = 0; i < rep.npages; ) {
+		if(rep.offsets[i] == MMU_PROTO_NO_OFFSET) {
+			i++;
+			continue;
+		}
+		assert(rep.prots[i] != PROT_NONE);
+		uint32_t n = 1;
+		while(i + n < rep.npages && rep.offsets[i + n] != MMU_PROTO_NO_OFFSET
+				&& rep.offsets[i + n] == rep.offsets[i] + n * pagesz
+				&& rep.prots[i + n] == rep.prots[i])
+			n++;
+		void *addr = (void *)(intptr_t)(rep.vaddr + i * pagesz);
+		int prot = (int)rep.prots[i];
+		off_t off = (off_t)rep.offsets[i];
+		logd(LOG_DEBUG, "remapping %p at offset %llu npages %u prot %d\n",
+				addr, (unsigned long long)off, n, prot);
+		munmap(addr, n * pagesz);
+		void *r = mmap(addr, n * pagesz, prot, MAP_SHARED, uvm->pmem_fd, off);
+		if(r != addr)
+			prexit();
+		i += n;
+	}
+
+	struct mmu_proto_remap_range_req req;
+	req.type = MMU_PROTO_REMAP_RANGE_REQ;
+	req.id = rep.id;
 	if(send(uvm->sock, &req, sizeof(req), 0) != sizeof(req)) prexit();
 }/*}}}*/
 
@@ -342,9 +1062,45 @@ void uvm_proto_chprot_rep(void)/*{{{*/
 
 	struct mmu_proto_chprot_req req;
 	req.type = MMU_PROTO_CHPROT_REQ;
+	req.id = rep.id;
 	if(send(uvm->sock, &req, sizeof(req), 0) != sizeof(req)) prexit();
 }/*}}}*/
 
+/****************************************************************************
+ * request slots
+ ***************************************************************************/
+uint32_t uvm_request_begin(void)/*{{{*/
+{
+	while(1) {
+		for(uint32_t i = 0; i < UVM_MAX_REQUESTS; ++i) {
+			if(uvm->requests[i].busy) continue;
+			uvm->requests[i].busy = 1;
+			uvm->requests[i].done = 0;
+			return i;
+		}
+		pthread_cond_wait(&uvm->cond, &uvm->mutex);
+	}
+}/*}}}*/
+
+intptr_t uvm_request_wait(uint32_t id)/*{{{*/
+{
+	struct uvm_request *r = &uvm->requests[id];
+	while(!r->done)
+		pthread_cond_wait(&r->cond, &uvm->mutex);
+	r->busy = 0;
+	pthread_cond_signal(&uvm->cond);
+	return r->result;
+}/*}}}*/
+
+void uvm_request_complete(uint32_t id, intptr_t result, intptr_t aux)/*{{{*/
+{
+	if(id >= UVM_MAX_REQUESTS || !uvm->requests[id].busy) prexit();
+	uvm->requests[id].result = result;
+	uvm->requests[id].aux = aux;
+	uvm->requests[id].done = 1;
+	pthread_cond_signal(&uvm->requests[id].cond);
+}/*}}}*/
+
 /****************************************************************************
  * external functions
  ***************************************************************************/
@@ -6,6 +6,7 @@
 #define __UVM_HEADER__
 
 #include <stdlib.h>
+#include <sys/types.h>
 
 /* `uvm_create` should be called when a program starts to bind it to
  * the memory management infrastructure.  This function sets up
@@ -16,12 +17,21 @@ void uvm_create(void);
 /* `uvm_extend` allocates a new page for the calling process and
  * returns the address where the page was mapped.  This is analogous
  * to the `sbrk` system call.  Memory allocated with `uvm_extend` is
- * managed by the memory infrastructure, and must not be `free`d.
+ * managed by the memory infrastructure, and must not be `free`d
+ * (use `uvm_release` instead).
  * `uvm_extend` fails, returns NULL, and sets `errno` to ENOSPC if
  * the memory infrastructure swap (disk) is out of space.  The
  * system page size is given by `sysconf(_SC_PAGESIZE)`. */
 void * uvm_extend(void);
 
+/* `uvm_extend_n` allocates `npages` consecutive pages in a single
+ * request to the memory infrastructure and returns the address of
+ * the first one.  Allocation is all-or-nothing: `uvm_extend_n`
+ * fails, returns NULL, and sets `errno` to ENOSPC if swap has fewer
+ * than `npages` free blocks or the address space has no room for
+ * the range. */
+void * uvm_extend_n(size_t npages);
+
 /* `uvm_syslog` requests the memory infrastructure to write the
  * string at `addr` with `len` bytes.  Memory at `addr` must be
  * managed by the memory infrastructure (i.e., allocated with
@@ -29,4 +39,153 @@ void * uvm_extend(void);
  * sets `errno` to EINVAL. */
 int uvm_syslog(void *addr, size_t len);
 
+/* `uvm_release` returns the `npages` pages starting at `addr` to the
+ * memory infrastructure, which frees their frames and disk blocks
+ * immediately; their contents are discarded.  `addr` must be
+ * page-aligned and all pages in the range must have been allocated
+ * with `uvm_extend`.  Released pages are unmapped and accessing them
+ * is an error; later calls to `uvm_extend` may return them again.
+ * Returns 0 on success; on failure, returns -1 and sets `errno` to
+ * EINVAL. */
+int uvm_release(void *addr, size_t npages);
+
+/* `uvm_share` creates a shared memory segment called `name` with
+ * `npages` pages and maps it into the calling process, returning
+ * the address of its first page.  Other processes map the segment
+ * with `uvm_attach`; all of them see each other's writes.  The
+ * segment lives until every process has released its pages with
+ * `uvm_release` or exited.  On failure, returns NULL and sets `errno`
+ * to EEXIST if a segment called `name` exists, to ENAMETOOLONG if
+ * `name` is too long, or to ENOSPC if swap or the address space is
+ * out of space. */
+void * uvm_share(const char *name, size_t npages);
+
+/* `uvm_attach` maps the shared segment called `name` into the
+ * calling process and returns the address of its first page.  If
+ * `npages` is not NULL, the number of pages in the segment is stored
+ * in it.  On failure, returns NULL and sets `errno` to ENOENT if no
+ * segment is called `name`, to ENAMETOOLONG if `name` is too long,
+ * or to ENOSPC if the address space is out of space. */
+void * uvm_attach(const char *name, size_t *npages);
+
+/* `uvm_mmap` maps `len` bytes of the file at `path`, starting at
+ * the page-aligned `offset`, into the calling process and returns
+ * the address of the first page.  The mapping is shared: writes go
+ * back to the file (which is never grown) and are seen by every
+ * process mapping it.  Bytes past the end of the file read as zero.
+ * Pages are unmapped with `uvm_release`.  On failure, returns NULL
+ * and sets `errno` to EINVAL if `offset` is not aligned or `len` is
+ * zero, to ENOSPC if the address space is out of space, or to the
+ * error raised opening the file. */
+void * uvm_mmap(const char *path, off_t offset, size_t len);
+
+/* `uvm_checkpoint` saves the memory allocated with `uvm_extend` to
+ * a snapshot file at `path`, without paging anything in or out.
+ * Shared segments and mapped files are not saved.  Other threads
+ * should not write to managed memory during the call.  Returns 0 on
+ * success; on failure, returns -1 and sets `errno`. */
+int uvm_checkpoint(const char *path);
+
+/* `uvm_restore` gives the calling process the memory saved in the
+ * snapshot at `path`, at the same addresses it had when saved.  It
+ * must be called right after `uvm_create`, before allocating memory.
+ * Pages are read from the snapshot only when first accessed, so
+ * restoring is fast whatever the size of the snapshot.  Returns 0
+ * on success; on failure, returns -1 and sets `errno` to EBUSY if
+ * memory was already allocated, to EINVAL if `path` is not a
+ * snapshot, or to ENOSPC if swap is out of space. */
+int uvm_restore(const char *path);
+
+/* `uvm_persist` binds the memory of the calling process to `key`, so
+ * that it outlives the process.  It must be called right after
+ * `uvm_create`, before allocating memory.  If memory bound to `key`
+ * was left by a process that exited, the calling process gets it
+ * back, at the same addresses; pages come back from swap as they are
+ * accessed, without reloading them.  When the MMU runs with a swap
+ * file, memory swapped out before an MMU restart is kept as well.
+ * Shared segments and mapped files are not persistent.  Returns 0
+ * on success; on failure, returns -1 and sets `errno` to EBUSY if
+ * memory was already allocated, to EEXIST if a running process holds
+ * `key`, to EINVAL if `key` is empty, or to ENAMETOOLONG if `key` is
+ * too long. */
+int uvm_persist(const char *key);
+
+/* `uvm_unpersist` unbinds the memory of the calling process from its
+ * key, so it is freed when the process exits.  Returns 0 on success;
+ * if the memory is not persistent, returns -1 and sets `errno` to
+ * EINVAL. */
+int uvm_unpersist(void);
+
+/* `uvm_limit` sets limits on the memory of the calling process; 0
+ * indicates no limit.  Pages of a process with at most `min_frames`
+ * pages in physical memory are not paged out to make room for other
+ * processes.  A process with `max_frames` pages in physical memory
+ * pages out one of its own for each page it brings in; with `local`
+ * set, it does so whenever physical memory is full, instead of paging
+ * out other processes.  Limits are ignored when they would prevent
+ * paging anything out.  `uvm_extend` fails with ENOSPC once the
+ * process has allocated `max_blocks` pages (shared segments and
+ * mapped files do not count).  Returns 0 on success; on failure,
+ * returns -1 and sets `errno` to EINVAL if a limit is negative or
+ * `min_frames` exceeds `max_frames`, or to ENOSPC if the minimums of
+ * all processes would take every frame. */
+int uvm_limit(int min_frames, int max_frames, int max_blocks, int local);
+
+#define UVM_MRC_POINTS 16
+
+/* Paging counters kept by the memory infrastructure, see
+ * `uvm_stats`. */
+struct uvm_stats {
+	unsigned long long minor_faults; /* faults on pages in memory */
+	unsigned long long major_faults; /* faults bringing pages in */
+	unsigned long long zero_fills; /* pages brought in zeroed */
+	unsigned long long swap_ins; /* pages brought in from swap */
+	unsigned long long evictions; /* pages paged out */
+	unsigned long long writebacks; /* modified pages written out */
+	unsigned long long second_chances; /* pages spared by replacement */
+	unsigned long long suspensions; /* times suspended for thrashing */
+	unsigned long long resident; /* pages in physical memory */
+	unsigned long long swap; /* disk blocks allocated */
+	/* Estimated miss-ratio curve, all 0 unless the pager samples
+	 * faults (see PAGER_SHARDS_SAMPLES): with memory for (i + 1) / 8
+	 * of the physical frames, `mrc_misses[i]` of the `mrc_refs`
+	 * sampled references would fault. */
+	unsigned long long mrc_refs;
+	unsigned long long mrc_misses[UVM_MRC_POINTS];
+};
+
+/* `uvm_stats` stores the paging counters of the calling process in
+ * `stats` and those of the whole system, including processes that
+ * exited, in `total`; either may be NULL.  Counters of events
+ * (faults to second chances) only grow, `resident` and `swap` give
+ * current usage.  Pages shared with other processes count for each
+ * of them, but once in the system-wide counters.  Returns 0 on
+ * success. */
+int uvm_stats(struct uvm_stats *stats, struct uvm_stats *total);
+
+/* `uvm_resize` changes the physical memory and the disk of the whole
+ * system to `nframes` frames and `nblocks` blocks while processes
+ * keep running; zero keeps the current size.  Pages in removed
+ * frames are moved to free frames or paged out, and pages in removed
+ * blocks are moved to free blocks.  Returns 0 on success; on
+ * failure, returns -1 and sets `errno` to EINVAL if a size is out of
+ * the MMU's range, to ENOSPC if the allocated pages, the processes or
+ * the shared segments would not fit in `nblocks`, or if the minimums
+ * set with `uvm_limit` would take every frame, or to EBUSY if a
+ * `uvm_fork` is in progress that the shrink would disturb. */
+int uvm_resize(int nframes, int nblocks);
+
+/* `uvm_fork` forks the calling process.  The child gets a
+ * copy-on-write clone of the memory allocated with `uvm_extend`:
+ * both processes share pages until either writes to one.  Like
+ * `fork`, it returns 0 in the child and the child's PID in the
+ * parent, which returns only after the child is registered with the
+ * memory infrastructure.  Only the calling thread is copied into the
+ * child; other threads must not access managed memory while
+ * `uvm_fork` runs.  On failure, returns -1 and sets `errno` to
+ * ENOSPC if swap has too few free blocks to back the copies, or to
+ * the error `pipe` or `fork` failed with (such as EAGAIN); the
+ * calling process keeps running. */
+pid_t uvm_fork(void);
+
 #endif
@@ -0,0 +1,37 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "uvm.h"
+
+// release dirty page without writeback
+// reuse released page
+// shrink heap
+int main(void) {
+	uvm_create();
+	size_t pagesz = sysconf(_SC_PAGESIZE);
+	char *page0 = uvm_extend();
+	char *page1 = uvm_extend();
+	char *page2 = uvm_extend();
+	page0[0] = 'a';
+	page1[0] = 'b';
+	page2[0] = 'c';
+	assert(uvm_release(page1, 1) == 0);
+	assert(uvm_release(page1, 1) == -1);
+	assert(errno == EINVAL);
+	assert(uvm_release(page0 + 1, 1) == -1);
+	assert(uvm_release(page0, (size_t)1 << 32) == -1);
+	assert(errno == EINVAL);
+	char *page3 = uvm_extend();
+	assert(page3 == page1);
+	printf("%c\n", page3[0]);
+	assert(uvm_release(page2, 1) == 0);
+	char *page4 = uvm_extend();
+	assert(page4 == page0 + 2*pagesz);
+	printf("%c\n", page4[0]);
+	printf("%c\n", page0[0]);
+	exit(EXIT_SUCCESS);
+}
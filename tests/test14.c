@@ -0,0 +1,51 @@
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "uvm.h"
+
+int num_threads = 4;
+int num_pages = 2;
+int num_loops = 16; /* run with ./mmu 16 16 */
+char *shared = NULL;
+
+void * worker(void *arg) {
+	int tid = (int)(intptr_t)arg;
+	char **pages = malloc(num_pages * sizeof(pages[0]));
+	for(int i = 0; i < num_pages; ++i) {
+		pages[i] = uvm_extend();
+		assert(pages[i] != NULL);
+	}
+	for(int i = 0; i < num_loops; ++i) {
+		for(int j = 0; j < num_pages; ++j) {
+			pages[j][i] = 'a' + tid;
+			assert(shared[0] == '0');
+		}
+	}
+	for(int i = 0; i < num_loops; ++i) {
+		for(int j = 0; j < num_pages; ++j) {
+			assert(pages[j][i] == 'a' + tid);
+		}
+	}
+	assert(uvm_syslog(pages[0], num_loops) == 0);
+	free(pages);
+	return NULL;
+}
+
+// concurrent extend, fault and syslog from several threads
+int main(void) {
+	uvm_create();
+	shared = uvm_extend();
+	pthread_t threads[num_threads];
+	for(int i = 0; i < num_threads; ++i) {
+		pthread_create(&threads[i], NULL, worker, (void *)(intptr_t)i);
+	}
+	for(int i = 0; i < num_threads; ++i) {
+		pthread_join(threads[i], NULL);
+	}
+	printf("%d threads done\n", num_threads);
+	exit(EXIT_SUCCESS);
+}
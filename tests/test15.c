@@ -0,0 +1,31 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "uvm.h"
+
+// extend range
+// range larger than swap fails without allocating
+// range skips holes that are too small
+int main(void) {
+	uvm_create();
+	size_t pagesz = sysconf(_SC_PAGESIZE);
+	char *base = uvm_extend_n(4);
+	assert(base != NULL);
+	base[0] = 'a';
+	base[3*pagesz] = 'd';
+	assert(uvm_extend_n(5) == NULL);
+	assert(errno == ENOSPC);
+	assert(uvm_release(base + pagesz, 2) == 0);
+	char *range = uvm_extend_n(3);
+	assert(range == base + 4*pagesz);
+	char *page = uvm_extend();
+	assert(page == base + pagesz);
+	printf("%c\n", base[0]);
+	printf("%c\n", base[3*pagesz]);
+	printf("%c\n", range[2*pagesz]);
+	exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,39 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "uvm.h"
+
+// fork shares pages read-only
+// child write breaks sharing (copy on write)
+// parent memory unchanged after child exits
+int main(void) {
+	uvm_create();
+	char *page0 = uvm_extend();
+	char *page1 = uvm_extend();
+	char *page2 = uvm_extend();
+	strcpy(page0, "shared");
+	strcpy(page1, "parent");
+	fflush(stdout);
+	pid_t pid = uvm_fork();
+	assert(pid != -1);
+	if(pid == 0) {
+		printf("%s\n", page0);
+		strcpy(page1, "child");
+		printf("%s\n", page1);
+		strcpy(page2, "fresh");
+		printf("%s\n", page2);
+		exit(EXIT_SUCCESS);
+	}
+	int status;
+	assert(waitpid(pid, &status, 0) == pid);
+	assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+	printf("%s\n", page1);
+	page1[0] = 'P';
+	printf("%s\n", page1);
+	printf("%c\n", page2[0]);
+	exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,50 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "uvm.h"
+
+// shared segment writes seen by every mapper
+// segment survives a mapper exiting and eviction
+// segment freed when the last mapper releases it
+int main(void) {
+	uvm_create();
+	size_t pagesz = sysconf(_SC_PAGESIZE);
+	char *seg = uvm_share("seg", 2);
+	assert(seg != NULL);
+	assert(uvm_share("seg", 1) == NULL);
+	assert(errno == EEXIST);
+	assert(uvm_attach("none", NULL) == NULL);
+	assert(errno == ENOENT);
+	strcpy(seg, "hello");
+	fflush(stdout);
+	pid_t pid = uvm_fork();
+	assert(pid != -1);
+	if(pid == 0) {
+		size_t npages;
+		char *other = uvm_attach("seg", &npages);
+		assert(other != NULL && other != seg);
+		printf("%zu %s\n", npages, other);
+		strcpy(other + pagesz, "world");
+		printf("%s\n", seg + pagesz);
+		exit(EXIT_SUCCESS);
+	}
+	int status;
+	assert(waitpid(pid, &status, 0) == pid);
+	assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+	printf("%s\n", seg + pagesz);
+	char *pages[4];
+	for(int i = 0; i < 4; ++i) {
+		pages[i] = uvm_extend();
+		pages[i][0] = 'a' + i;
+	}
+	printf("%s %s\n", seg, seg + pagesz);
+	assert(uvm_release(seg, 2) == 0);
+	assert(uvm_attach("seg", NULL) == NULL);
+	assert(errno == ENOENT);
+	exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,68 @@
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "uvm.h"
+
+#define FILENAME "test18.dat"
+
+// file pages read from the file on fault
+// clean file pages dropped, dirty ones written back on eviction
+// processes mapping a file share its frames
+// file not grown past its end
+int main(void) {
+	uvm_create();
+	size_t pagesz = sysconf(_SC_PAGESIZE);
+	size_t filesz = 2*pagesz + 10;
+	char *buf = malloc(filesz);
+	for(size_t i = 0; i < filesz; ++i) buf[i] = 'a' + (i / pagesz);
+	int fd = open(FILENAME, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	assert(fd != -1);
+	assert(write(fd, buf, filesz) == (ssize_t)filesz);
+
+	assert(uvm_mmap(FILENAME, 1, pagesz) == NULL);
+	assert(errno == EINVAL);
+	assert(uvm_mmap("test18.none", 0, pagesz) == NULL);
+	assert(errno == ENOENT);
+
+	char *file = uvm_mmap(FILENAME, 0, filesz);
+	assert(file != NULL);
+	printf("%c %c %c %d\n", file[0], file[pagesz], file[2*pagesz + 9],
+			file[2*pagesz + 10]);
+	file[pagesz] = 'X';
+	file[2*pagesz + 10] = 'Y';
+
+	fflush(stdout);
+	pid_t pid = uvm_fork();
+	assert(pid != -1);
+	if(pid == 0) {
+		char *other = uvm_mmap(FILENAME, pagesz, pagesz);
+		assert(other != NULL);
+		printf("%c\n", other[0]);
+		other[1] = 'Z';
+		exit(EXIT_SUCCESS);
+	}
+	int status;
+	assert(waitpid(pid, &status, 0) == pid);
+	assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+	for(int i = 0; i < 4; ++i) {
+		char *page = uvm_extend();
+		page[0] = '0' + i;
+	}
+	printf("%c %c %c\n", file[0], file[pagesz], file[pagesz + 1]);
+	assert(uvm_release(file, 3) == 0);
+
+	assert(pread(fd, buf, filesz + 1, 0) == (ssize_t)filesz);
+	printf("%c %c %c %c\n", buf[0], buf[pagesz], buf[pagesz + 1],
+			buf[2*pagesz]);
+	close(fd);
+	unlink(FILENAME);
+	free(buf);
+	exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,66 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "uvm.h"
+
+#define SNAPSHOT "test19.snap"
+
+// checkpoint saves resident, swapped out and untouched pages
+// restore maps the snapshot at the same addresses
+// restored pages read from the snapshot on fault
+// checkpoint over the snapshot a process was restored from
+int main(int argc, char **argv) {
+	size_t pagesz = sysconf(_SC_PAGESIZE);
+	char *base = (char *)0x60000000;
+	if(argc > 1) {
+		uvm_create();
+		assert(uvm_restore(SNAPSHOT) == 0);
+		printf("%s\n", base + pagesz);
+		printf("%s\n", base + 3*pagesz);
+		exit(EXIT_SUCCESS);
+	}
+	int status;
+	pid_t pid = fork();
+	assert(pid != -1);
+	if(pid == 0) {
+		uvm_create();
+		char *pages[7];
+		for(int i = 0; i < 7; ++i) pages[i] = uvm_extend();
+		for(int i = 0; i < 6; ++i) sprintf(pages[i], "page%d", i);
+		assert(uvm_release(pages[2], 1) == 0);
+		assert(uvm_checkpoint(SNAPSHOT) == 0);
+		exit(EXIT_SUCCESS);
+	}
+	assert(waitpid(pid, &status, 0) == pid);
+	assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+	uvm_create();
+	assert(uvm_restore("test19.none") == -1);
+	assert(errno == ENOENT);
+	assert(uvm_restore(SNAPSHOT) == 0);
+	assert(uvm_restore(SNAPSHOT) == -1);
+	assert(errno == EBUSY);
+	printf("%s\n", base + 4*pagesz);
+	printf("%s\n", base);
+	printf("%c\n", base[6*pagesz]);
+	strcpy(base + pagesz, "changed");
+	assert(uvm_checkpoint(SNAPSHOT) == 0);
+	fflush(stdout);
+	pid = fork();
+	assert(pid != -1);
+	if(pid == 0) {
+		execl("/proc/self/exe", argv[0], "restore", NULL);
+		exit(EXIT_FAILURE);
+	}
+	assert(waitpid(pid, &status, 0) == pid);
+	assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+	char *page2 = uvm_extend();
+	assert(page2 == base + 2*pagesz);
+	unlink(SNAPSHOT);
+	exit(EXIT_SUCCESS);
+}
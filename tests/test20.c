@@ -0,0 +1,65 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "uvm.h"
+
+#define KEY "test20"
+
+// persistent memory outlives the process that allocated it
+// resident and swapped out pages come back at the same addresses
+// a key is held by one process at a time
+// unpersisted memory is freed at exit
+int main(int argc, char **argv) {
+	size_t pagesz = sysconf(_SC_PAGESIZE);
+	char *base = (char *)0x60000000;
+	if(argc > 1) {
+		uvm_create();
+		assert(uvm_persist(KEY) == -1);
+		assert(errno == EEXIST);
+		exit(EXIT_SUCCESS);
+	}
+	int status;
+	pid_t pid = fork();
+	assert(pid != -1);
+	if(pid == 0) {
+		uvm_create();
+		assert(uvm_persist(KEY) == 0);
+		char *pages[6];
+		for(int i = 0; i < 6; ++i) pages[i] = uvm_extend();
+		for(int i = 0; i < 6; ++i) sprintf(pages[i], "page%d", i);
+		assert(uvm_release(pages[2], 1) == 0);
+		exit(EXIT_SUCCESS);
+	}
+	assert(waitpid(pid, &status, 0) == pid);
+	assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+	uvm_create();
+	assert(uvm_persist("") == -1);
+	assert(errno == EINVAL);
+	assert(uvm_persist(KEY) == 0);
+	assert(uvm_persist(KEY) == -1);
+	assert(errno == EBUSY);
+	for(int i = 0; i < 6; ++i) {
+		if(i != 2) printf("%s\n", base + i*pagesz);
+	}
+	char *page2 = uvm_extend();
+	assert(page2 == base + 2*pagesz);
+	fflush(stdout);
+	pid = fork();
+	assert(pid != -1);
+	if(pid == 0) {
+		execl("/proc/self/exe", argv[0], "exists", NULL);
+		exit(EXIT_FAILURE);
+	}
+	assert(waitpid(pid, &status, 0) == pid);
+	assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+	assert(uvm_unpersist() == 0);
+	assert(uvm_unpersist() == -1);
+	assert(errno == EINVAL);
+	exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,32 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "uvm.h"
+
+// same-filled pages are not written to disk on eviction
+// they come back with the byte they were filled with
+// a written same-filled page is written to disk again when mixed
+int main(void) {
+	uvm_create();
+	size_t pagesz = sysconf(_SC_PAGESIZE);
+	char *pages[6];
+	for(int i = 0; i < 6; ++i) pages[i] = uvm_extend();
+	memset(pages[0], 'a', pagesz);
+	memset(pages[1], 0, pagesz);
+	pages[2][0] = '0';
+	memset(pages[3], 'b', pagesz);
+	pages[3][pagesz - 1] = 'c';
+	memset(pages[4], 'd', pagesz);
+	memset(pages[5], 'e', pagesz);
+	printf("%c %d %c %c %c\n", pages[0][pagesz - 1], pages[1][pagesz - 1],
+			pages[2][pagesz - 1], pages[3][pagesz - 1], pages[5][0]);
+	pages[0][1] = 'x';
+	memset(pages[1], 'f', pagesz);
+	for(int i = 2; i < 6; ++i) pages[i][0] = pages[i][0];
+	printf("%c%c %c %c %c\n", pages[0][0], pages[0][1], pages[1][0],
+			pages[3][0], pages[4][pagesz - 1]);
+	exit(EXIT_SUCCESS);
+}
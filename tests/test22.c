@@ -0,0 +1,27 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "uvm.h"
+
+// pages swapped in and only read keep their copy on disk
+// evicting them again writes nothing
+// they come back from disk with the contents written before
+int main(void) {
+	uvm_create();
+	size_t pagesz = sysconf(_SC_PAGESIZE);
+	char *pages[6];
+	for(int i = 0; i < 6; ++i) {
+		pages[i] = uvm_extend();
+		memset(pages[i], 'a' + i, pagesz);
+		pages[i][pagesz - 1] = 'A' + i;
+	}
+	for(int round = 0; round < 2; ++round) {
+		for(int i = 0; i < 6; ++i) {
+			printf("%c%c ", pages[i][0], pages[i][pagesz - 1]);
+		}
+		printf("\n");
+	}
+	exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,31 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "uvm.h"
+
+// invalid limits are refused
+// minimums cannot take every frame
+// a process at its frame quota pages out its own pages
+// a process at its swap quota cannot extend
+int main(void) {
+	uvm_create();
+	size_t pagesz = sysconf(_SC_PAGESIZE);
+	int r = uvm_limit(3, 2, 0, 0);
+	printf("%d %d\n", r, r == -1 && errno == EINVAL);
+	r = uvm_limit(4, 0, 0, 0);
+	printf("%d %d\n", r, r == -1 && errno == ENOSPC);
+	printf("%d\n", uvm_limit(1, 2, 3, 0));
+	char *pages[3];
+	for(int i = 0; i < 3; ++i) {
+		pages[i] = uvm_extend();
+		memset(pages[i], 'a' + i, pagesz);
+	}
+	char *page = uvm_extend();
+	printf("%d %d\n", page == NULL, errno == ENOSPC);
+	for(int i = 0; i < 3; ++i) printf("%c", pages[i][0]);
+	printf("\n");
+	exit(EXIT_SUCCESS);
+}
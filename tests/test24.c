@@ -0,0 +1,28 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "uvm.h"
+
+// syslog spanning two pages faults in the non-resident one
+// bytes above 0x7f print as two hex digits
+// a range running past the allocated pages is refused
+int main(void) {
+	uvm_create();
+	size_t pagesz = sysconf(_SC_PAGESIZE);
+	char *pages[5];
+	for(int i = 0; i < 5; ++i) {
+		pages[i] = uvm_extend();
+		memset(pages[i], 'a' + i, pagesz);
+	}
+	for(int i = 0; i < 20; ++i) {
+		pages[0][pagesz - 20 + i] = (char)(0xf0 + i);
+	}
+	for(int i = 1; i < 5; ++i) pages[i][0] = pages[i][0];
+	printf("%d\n", uvm_syslog(pages[0] + pagesz - 20, 40));
+	int r = uvm_syslog(pages[4] + pagesz - 2, 4);
+	printf("%d %d\n", r, r == -1 && errno == EINVAL);
+	exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,41 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "uvm.h"
+
+static void print_stats(const struct uvm_stats *s) {
+	printf("%llu %llu %llu %llu %llu %llu %llu %llu %llu\n",
+			s->minor_faults, s->major_faults, s->zero_fills,
+			s->swap_ins, s->evictions, s->writebacks,
+			s->second_chances, s->resident, s->swap);
+}
+
+// counters start at zero
+// pages touched for the first time are filled
+// pages written after being read take minor faults
+// pages paged out are written back and swapped in again
+// pages brought in by syslog count as major faults
+int main(void) {
+	uvm_create();
+	size_t pagesz = sysconf(_SC_PAGESIZE);
+	struct uvm_stats stats, total;
+	uvm_stats(&stats, &total);
+	print_stats(&stats);
+	char *pages[5];
+	for(int i = 0; i < 5; ++i) pages[i] = uvm_extend();
+	printf("%c\n", pages[0][0]);
+	pages[0][0] = 'a';
+	uvm_stats(&stats, NULL);
+	print_stats(&stats);
+	for(int i = 1; i < 5; ++i) memset(pages[i], 'a' + i, pagesz);
+	printf("%c\n", pages[0][0]);
+	uvm_stats(&stats, &total);
+	print_stats(&stats);
+	print_stats(&total);
+	uvm_syslog(pages[1], 4);
+	uvm_stats(&stats, NULL);
+	print_stats(&stats);
+	exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,52 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "uvm.h"
+
+static void check(char **pages, int first, int n) {
+	for(int i = first; i < first + n; ++i)
+		printf("%c%c", pages[i][0], pages[i][1]);
+	printf("\n");
+}
+
+// added blocks can be allocated and added frames hold more pages
+// removed frames are moved to free frames or paged out
+// removed blocks in use are moved to free blocks
+// sizes that are out of range or too small fail
+int main(void) {
+	uvm_create();
+	size_t pagesz = sysconf(_SC_PAGESIZE);
+	struct uvm_stats stats;
+	char *pages[12];
+	for(int i = 0; i < 8; ++i) {
+		pages[i] = uvm_extend();
+		memset(pages[i], 'a' + i, pagesz);
+		pages[i][1] = '0' + i;
+	}
+	printf("%d\n", uvm_extend() == NULL && errno == ENOSPC);
+	printf("%d\n", uvm_resize(8, 16));
+	for(int i = 8; i < 12; ++i) {
+		pages[i] = uvm_extend();
+		memset(pages[i], 'a' + i, pagesz);
+		pages[i][1] = '0' + i;
+	}
+	check(pages, 0, 12);
+	uvm_stats(NULL, &stats);
+	printf("%llu %llu\n", stats.resident, stats.swap);
+	uvm_release(pages[0], 2);
+	uvm_release(pages[10], 2);
+	printf("%d\n", uvm_resize(4, 0));
+	uvm_stats(NULL, &stats);
+	printf("%llu %llu\n", stats.resident, stats.swap);
+	printf("%d %d\n", uvm_resize(0, 4), errno);
+	printf("%d\n", uvm_resize(0, 8));
+	uvm_stats(NULL, &stats);
+	printf("%llu %llu\n", stats.resident, stats.swap);
+	check(pages, 2, 8);
+	printf("%d %d\n", uvm_resize(-1, 0), errno);
+	printf("%d %d\n", uvm_resize(0, 2048), errno);
+	exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,43 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "uvm.h"
+
+int num_loops = 30;
+
+// syslogs of two processes running at once are printed whole
+// each line holds the bytes of the process that logged it
+// syslogs bringing pages in while the other process logs too
+int main(void) {
+	uvm_create();
+	size_t pagesz = sysconf(_SC_PAGESIZE);
+	fflush(stdout);
+	pid_t pid = uvm_fork();
+	assert(pid != -1);
+	char base = pid == 0 ? 'a' : 'A';
+	char *pages[3];
+	for(int i = 0; i < 3; ++i) {
+		pages[i] = uvm_extend();
+		assert(pages[i] != NULL);
+		memset(pages[i], base + i, pagesz);
+	}
+	for(int i = 0; i < num_loops; ++i) {
+		char *addr = pages[i % 2] + pagesz - 64;
+		assert(uvm_syslog(addr, 128) == 0);
+		if(i % 10 == 9)
+			assert(uvm_syslog(pages[2] - pagesz / 4, pagesz / 2) == 0);
+	}
+	if(pid == 0) {
+		printf("child done\n");
+		exit(EXIT_SUCCESS);
+	}
+	int status;
+	assert(waitpid(pid, &status, 0) == pid);
+	assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+	printf("parent done\n");
+	exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,42 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "uvm.h"
+
+// pages given a second chance before a fork are shared copy-on-write
+// reads of them in either process keep the sharing
+// a write still gets a private copy
+int main(void) {
+	uvm_create();
+	size_t pagesz = sysconf(_SC_PAGESIZE);
+	struct uvm_stats total;
+	char *pages[5];
+	for(int i = 0; i < 5; ++i) {
+		pages[i] = uvm_extend();
+		memset(pages[i], 'a' + i, pagesz);
+	}
+	fflush(stdout);
+	pid_t pid = uvm_fork();
+	assert(pid != -1);
+	if(pid == 0) {
+		for(int i = 1; i < 4; ++i) printf("%c", pages[i][0]);
+		printf("\n");
+		uvm_stats(NULL, &total);
+		printf("%llu %llu\n", total.resident, total.evictions);
+		pages[1][0] = 'B';
+		printf("%c\n", pages[1][0]);
+		exit(EXIT_SUCCESS);
+	}
+	int status;
+	assert(waitpid(pid, &status, 0) == pid);
+	assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+	for(int i = 1; i < 4; ++i) printf("%c", pages[i][0]);
+	printf("\n");
+	uvm_stats(NULL, &total);
+	printf("%llu %llu\n", total.resident, total.evictions);
+	exit(EXIT_SUCCESS);
+}
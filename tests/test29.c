@@ -0,0 +1,56 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "uvm.h"
+
+static void print_resident(void) {
+	struct uvm_stats total;
+	uvm_stats(NULL, &total);
+	printf("%llu\n", total.resident);
+}
+
+// run with PAGER_KSM_INTERVAL=20
+// pages two processes fill with the same data are merged
+// reads of merged pages keep them merged
+// a write splits the page it writes
+int main(void) {
+	size_t pagesz = sysconf(_SC_PAGESIZE);
+	int filled[2], split[2];
+	assert(pipe(filled) == 0 && pipe(split) == 0);
+	pid_t pid = fork();
+	assert(pid != -1);
+	uvm_create();
+	char *pages[3];
+	for(int i = 0; i < 3; ++i) {
+		pages[i] = uvm_extend();
+		memset(pages[i], 'a' + i, pagesz);
+	}
+	char c = 0;
+	if(pid == 0) {
+		assert(write(filled[1], &c, 1) == 1);
+		assert(read(split[0], &c, 1) == 1);
+		for(int i = 0; i < 3; ++i) printf("%c", pages[i][0]);
+		printf("\n");
+		exit(EXIT_SUCCESS);
+	}
+	assert(read(filled[0], &c, 1) == 1);
+	usleep(500000);
+	print_resident();
+	for(int i = 0; i < 3; ++i) printf("%c", pages[i][0]);
+	printf("\n");
+	print_resident();
+	pages[0][0] = 'A';
+	printf("%c\n", pages[0][0]);
+	print_resident();
+	fflush(stdout);
+	assert(write(split[1], &c, 1) == 1);
+	int status;
+	assert(waitpid(pid, &status, 0) == pid);
+	assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+	print_resident();
+	exit(EXIT_SUCCESS);
+}
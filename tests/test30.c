@@ -0,0 +1,82 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "uvm.h"
+
+static size_t pagesz;
+
+// half a page of noise, so that one page fills the pool
+static void fill_noise(char *page, unsigned seed) {
+	for(size_t i = 0; i < pagesz / 2; ++i) {
+		seed = seed * 1103515245 + 12345;
+		page[i] = (char)(seed >> 16);
+	}
+	memset(page + pagesz / 2, 0, pagesz / 2);
+}
+
+static int check_noise(const char *page, unsigned seed) {
+	for(size_t i = 0; i < pagesz / 2; ++i) {
+		seed = seed * 1103515245 + 12345;
+		if(page[i] != (char)(seed >> 16)) return 0;
+	}
+	for(size_t i = pagesz / 2; i < pagesz; ++i) {
+		if(page[i] != 0) return 0;
+	}
+	return 1;
+}
+
+static void fill_text(char *page) {
+	for(size_t i = 0; i < pagesz; ++i) page[i] = "zswap "[i % 6];
+}
+
+static int check_text(const char *page) {
+	for(size_t i = 0; i < pagesz; ++i) {
+		if(page[i] != "zswap "[i % 6]) return 0;
+	}
+	return 1;
+}
+
+static int check_fill(const char *page, char c) {
+	for(size_t i = 0; i < pagesz; ++i) {
+		if(page[i] != c) return 0;
+	}
+	return 1;
+}
+
+static void print_stats(void) {
+	struct uvm_stats stats;
+	uvm_stats(&stats, NULL);
+	printf("%llu %llu %llu\n", stats.swap_ins, stats.evictions, stats.writebacks);
+}
+
+// run with PAGER_ZSWAP_PAGES=1
+// evicted pages that compress are kept in the pool and read back from it
+// the pool writes its oldest page to disk when full
+// same-filled pages are neither stored nor written
+// every page reads back what was written
+int main(void) {
+	uvm_create();
+	pagesz = sysconf(_SC_PAGESIZE);
+	char *pages[4];
+	for(int i = 0; i < 4; ++i) pages[i] = uvm_extend();
+	fill_noise(pages[0], 1);
+	fill_noise(pages[1], 2);
+	memset(pages[2], 'x', pagesz);
+	fill_text(pages[3]);
+	print_stats();
+	printf("%d\n", check_noise(pages[1], 2));
+	printf("%d\n", check_noise(pages[0], 1));
+	printf("%d\n", check_fill(pages[2], 'x'));
+	printf("%d\n", check_text(pages[3]));
+	print_stats();
+	for(int round = 0; round < 2; ++round) {
+		printf("%d %d %d %d\n", check_noise(pages[0], 1),
+				check_noise(pages[1], 2), check_fill(pages[2], 'x'),
+				check_text(pages[3]));
+	}
+	print_stats();
+	exit(EXIT_SUCCESS);
+}
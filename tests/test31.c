@@ -0,0 +1,49 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "uvm.h"
+
+int num_pages = 8;
+int num_loops = 1000; /* run with ./mmu 8 32 and PAGER_THRASH_INTERVAL=20 */
+
+// two processes whose pages do not fit in memory together thrash
+// the younger one is suspended, and readmitted once memory frees up
+// both finish with the data they wrote
+static int run(char base) {
+	size_t pagesz = sysconf(_SC_PAGESIZE);
+	char *pages[num_pages];
+	for(int i = 0; i < num_pages; ++i) pages[i] = uvm_extend();
+	int ok = 1;
+	for(int loop = 0; loop < num_loops; ++loop) {
+		for(int i = 0; i < num_pages; ++i) {
+			if(loop > 0) ok = ok && pages[i][pagesz - 1] == base + (loop - 1) % 16;
+			memset(pages[i], base + loop % 16, pagesz);
+		}
+	}
+	return ok;
+}
+
+int main(void) {
+	uvm_create();
+	struct uvm_stats stats;
+	fflush(stdout);
+	pid_t pid = uvm_fork();
+	assert(pid != -1);
+	if(pid == 0) {
+		int ok = run('a');
+		uvm_stats(&stats, NULL);
+		printf("child %d %d\n", ok, stats.suspensions > 0);
+		exit(EXIT_SUCCESS);
+	}
+	int ok = run('A');
+	int status;
+	assert(waitpid(pid, &status, 0) == pid);
+	assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+	uvm_stats(&stats, NULL);
+	printf("parent %d %llu\n", ok, stats.suspensions);
+	exit(EXIT_SUCCESS);
+}
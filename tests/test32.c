@@ -0,0 +1,46 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "uvm.h"
+
+static void print_stats(void) {
+	struct uvm_stats stats;
+	uvm_stats(&stats, NULL);
+	printf("%llu %llu %llu %llu\n", stats.minor_faults,
+			stats.major_faults, stats.zero_fills, stats.resident);
+}
+
+// run with PAGER_SUPERPAGE_PAGES=4
+// a fault brings in the pages of its chunk that were allocated
+// pages of the chunk already resident, or released, are left alone
+// only the faulting page of a write fault is writable
+int main(void) {
+	uvm_create();
+	size_t pagesz = sysconf(_SC_PAGESIZE);
+	char *pages[12];
+	for(int i = 0; i < 6; ++i) pages[i] = uvm_extend();
+	printf("%c\n", pages[1][0]);
+	print_stats();
+	pages[5][0] = 'f';
+	print_stats();
+	pages[6] = uvm_extend();
+	pages[7] = uvm_extend();
+	memset(pages[7], 'h', pagesz);
+	print_stats();
+	printf("%c %c\n", pages[6][0], pages[5][0]);
+	print_stats();
+	memset(pages[6], 'g', pagesz);
+	print_stats();
+	for(int i = 8; i < 12; ++i) pages[i] = uvm_extend();
+	uvm_release(pages[9], 1);
+	char c = pages[8][0];
+	printf("%c%c%c\n", c, pages[10][0], pages[11][0]);
+	print_stats();
+	for(int i = 0; i < 12; ++i) {
+		if(i != 9) printf("%c", pages[i][0]);
+	}
+	printf("\n");
+	exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,67 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "uvm.h"
+
+#define KEY "test33"
+#define JOURNAL "mmu.swap.journal"
+#define JOURNAL_SIZE "mmu.swap.size"
+
+// run with the MMU keeping its disk in mmu.swap, then again with the
+// argument "restart" after restarting the MMU on the same swap file
+// persistent memory survives the restart, swapped out or resident
+// released pages stay released
+// the journal is compacted when the MMU starts
+int main(int argc, char **argv) {
+	size_t pagesz = sysconf(_SC_PAGESIZE);
+	char *base = (char *)0x60000000;
+	struct stat st;
+	if(argc == 1) {
+		pid_t pid = fork();
+		assert(pid != -1);
+		if(pid == 0) {
+			uvm_create();
+			assert(uvm_persist(KEY) == 0);
+			char *pages[8];
+			for(int i = 0; i < 8; ++i) pages[i] = uvm_extend();
+			for(int round = 0; round < 3; ++round) {
+				for(int i = 0; i < 8; ++i) {
+					sprintf(pages[i], "round%d page%d", round, i);
+				}
+			}
+			assert(uvm_release(pages[3], 1) == 0);
+			exit(EXIT_SUCCESS);
+		}
+		int status;
+		assert(waitpid(pid, &status, 0) == pid);
+		assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+		assert(stat(JOURNAL, &st) == 0);
+		FILE *fp = fopen(JOURNAL_SIZE, "w");
+		assert(fp != NULL);
+		fprintf(fp, "%lld\n", (long long)st.st_size);
+		fclose(fp);
+		printf("stopped\n");
+		exit(EXIT_SUCCESS);
+	}
+	long long before;
+	FILE *fp = fopen(JOURNAL_SIZE, "r");
+	assert(fp != NULL && fscanf(fp, "%lld", &before) == 1);
+	fclose(fp);
+	assert(stat(JOURNAL, &st) == 0);
+	printf("compacted %d\n", st.st_size < before);
+	uvm_create();
+	assert(uvm_persist(KEY) == 0);
+	for(int i = 0; i < 8; ++i) {
+		if(i != 3) printf("%s\n", base + i*pagesz);
+	}
+	char *page3 = uvm_extend();
+	assert(page3 == base + 3*pagesz);
+	printf("%c\n", page3[0]);
+	assert(uvm_unpersist() == 0);
+	exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,42 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "uvm.h"
+
+// a fork failing in the client returns -1 with its errno
+// the process keeps running, and later forks succeed
+int main(void) {
+	uvm_create();
+	char *page = uvm_extend();
+	page[0] = 'a';
+	struct rlimit limit, low;
+	assert(getrlimit(RLIMIT_NOFILE, &limit) == 0);
+	int fd = dup(0);
+	assert(fd != -1);
+	close(fd);
+	low = limit;
+	low.rlim_cur = fd + 1;
+	assert(setrlimit(RLIMIT_NOFILE, &low) == 0);
+	assert(uvm_fork() == -1);
+	printf("%d\n", errno == EMFILE);
+	assert(setrlimit(RLIMIT_NOFILE, &limit) == 0);
+	page[0] = 'b';
+	printf("%c\n", page[0]);
+	fflush(stdout);
+	pid_t pid = uvm_fork();
+	assert(pid != -1);
+	if(pid == 0) {
+		printf("%c\n", page[0]);
+		exit(EXIT_SUCCESS);
+	}
+	int status;
+	assert(waitpid(pid, &status, 0) == pid);
+	assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+	printf("done\n");
+	exit(EXIT_SUCCESS);
+}
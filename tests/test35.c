@@ -0,0 +1,29 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "uvm.h"
+
+static void print_curve(const struct uvm_stats *s) {
+	printf("%llu", s->mrc_refs);
+	for(int i = 0; i < UVM_MRC_POINTS; ++i) printf(" %llu", s->mrc_misses[i]);
+	printf("\n");
+}
+
+// a loop over 12 pages faults on every access with 8 frames
+// every reuse is 12 pages apart, so only the 12 first references
+// miss with memory for at least 12 frames (points 11 and above)
+int main(void) {
+	uvm_create();
+	char *pages[12];
+	for(int i = 0; i < 12; ++i) pages[i] = uvm_extend();
+	int sum = 0;
+	for(int round = 0; round < 4; ++round) {
+		for(int i = 0; i < 12; ++i) sum += pages[i][0];
+	}
+	printf("%d\n", sum);
+	struct uvm_stats stats, total;
+	uvm_stats(&stats, &total);
+	print_curve(&stats);
+	print_curve(&total);
+	exit(EXIT_SUCCESS);
+}
@@ -10,3 +10,27 @@
 10 4 8 0
 11 2 3 1
 12 256 1024 1
+13 4 8 0
+14 16 16 1
+15 4 8 0
+16 4 8 0
+17 4 8 0
+18 4 8 0
+19 4 16 0
+20 4 8 0
+21 4 8 0
+22 4 8 0
+23 4 8 0
+24 4 8 0
+25 4 8 0
+26 4 8 0
+27 4 8 2
+28 4 16 0
+29 8 16 2 PAGER_KSM_INTERVAL=20
+30 2 16 0 PAGER_ZSWAP_PAGES=1
+31 8 32 2 PAGER_THRASH_INTERVAL=20
+32 16 16 0 PAGER_SUPERPAGE_PAGES=4
+33 4 16 3
+34 4 8 0
+35 8 16 0 PAGER_SHARDS_SAMPLES=64
+36 4 16 0